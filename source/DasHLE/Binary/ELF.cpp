@@ -1,6 +1,8 @@
 #include "DasHLE/Support/Math.h"
 #include "DasHLE/Binary/ELF.h"
 
+#include <cstring>
+
 using namespace dashle;
 using namespace dashle::binary::elf;
 
@@ -64,6 +66,7 @@ Expected<void> ELF::visitRelArray32(const Rel32* relArray, usize size) {
                 .patchOffset = rel->r_offset,
                 .addend = 0,
                 .kind = RelocKind::Symbol,
+                .symbolIndex = rel->symbolIndex(),
                 .symbol = symbolName,
             });
             continue;
@@ -95,6 +98,7 @@ Expected<void> ELF::visitRelaArray32(const Rela32* relaArray, usize size) {
                 .patchOffset = rela->r_offset,
                 .addend = rela->r_addend,
                 .kind = RelocKind::Symbol,
+                .symbolIndex = rela->symbolIndex(),
                 .symbol = symbolName,
             });
             continue;
@@ -389,6 +393,43 @@ Expected<std::string> ELF::stringByOffset(usize offset) const {
     return reinterpret_cast<const char*>(binaryBase() + m_StrTab->ptr() + offset);
 }
 
+Expected<std::vector<SymbolInfo>> ELF::functionSymbols() const {
+    std::vector<SymbolInfo> symbols;
+
+    for (const auto type : { SHT_SYMTAB, SHT_DYNSYM }) {
+        DASHLE_TRY_EXPECTED_CONST(tables, sectionsOfType(type));
+        for (const auto& table : tables) {
+            DASHLE_TRY_EXPECTED_CONST(strings, sectionHeader(table->link()));
+
+            const auto entSize = is64Bits() ? sizeof(Sym64) : sizeof(Sym32);
+            if (table->entsize() != entSize || table->offset() + table->size() > m_Buffer.size()
+                || strings->offset() + strings->size() > m_Buffer.size())
+                return Unexpected(Error::InvalidSize);
+
+            const auto stringBase = reinterpret_cast<const char*>(binaryBase() + strings->offset());
+            for (auto i = 0u; i < table->size() / entSize; ++i) {
+                SymEntry symbol;
+                if (is64Bits()) {
+                    symbol = SymEntry64(&reinterpret_cast<const Sym64*>(binaryBase() + table->offset())[i]);
+                } else {
+                    symbol = SymEntry32(&reinterpret_cast<const Sym32*>(binaryBase() + table->offset())[i]);
+                }
+
+                if ((symbol->info() & 0xF) != STT_FUNC || symbol->shndx() == SHN_UNDEF || symbol->name() >= strings->size())
+                    continue;
+
+                symbols.push_back(SymbolInfo {
+                    .value = symbol->value(),
+                    .size = symbol->size(),
+                    .name = std::string(stringBase + symbol->name(), strnlen(stringBase + symbol->name(), strings->size() - symbol->name())),
+                });
+            }
+        }
+    }
+
+    return symbols;
+}
+
 Optional<FuncArrayInfo> ELF::initArrayInfo() const {
     const auto initEntryWrapper = dynEntryWithTag(DT_INIT_ARRAY);
     const auto initEntrySzWrapper = dynEntryWithTag(DT_INIT_ARRAYSZ);
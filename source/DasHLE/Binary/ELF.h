@@ -50,10 +50,15 @@ constexpr static auto DT_FINI_ARRAY	= 26;
 constexpr static auto DT_INIT_ARRAYSZ = 27;
 constexpr static auto DT_FINI_ARRAYSZ = 28;
 
+constexpr static auto SHT_SYMTAB = 2;
+constexpr static auto SHT_DYNSYM = 11;
 constexpr static auto SHT_LOPROC = 0x70000000;
 constexpr static auto SHT_ARM_ATTRIBUTES = SHT_LOPROC + 3;
 
 constexpr static auto STN_UNDEF	= 0;
+constexpr static auto SHN_UNDEF = 0;
+
+constexpr static auto STT_FUNC = 2;
 
 constexpr static auto PF_X = (1 << 0);
 constexpr static auto PF_W = (1 << 1);
@@ -421,9 +426,16 @@ struct RelocInfo {
     usize patchOffset;
     s64 addend;
     RelocKind kind;
+    usize symbolIndex = 0u;
     Optional<std::string> symbol;
 };
 
+struct SymbolInfo {
+    Addr64 value; // Offset from the binary base, Thumb functions have the low bit set.
+    Xword size;
+    std::string name;
+};
+
 struct FuncArrayInfo {
     usize offset;
     usize size;
@@ -500,6 +512,9 @@ public:
     Expected<SymEntry> symbolByIndex(usize index) const;
     Expected<std::string> stringByOffset(usize offset) const;
 
+    // Functions defined by the binary, from .symtab and .dynsym (stripped binaries only have the latter).
+    Expected<std::vector<SymbolInfo>> functionSymbols() const;
+
     Optional<FuncArrayInfo> initArrayInfo() const;
     Optional<FuncArrayInfo> finiArrayInfo() const;
 };
@@ -3,6 +3,7 @@
 
 #include "dynarmic/interface/exclusive_monitor.h"
 #include "dynarmic/interface/A32/a32.h"
+#include "dynarmic/interface/A32/coprocessor.h"
 #include "dynarmic/frontend/A32/a32_types.h"
 #include "dynarmic/frontend/A32/a32_ir_emitter.h"
 #include "dynarmic/interface/A64/a64.h"
@@ -1,3 +1,4 @@
+#include "DasHLE/Host/GuestPtr.h"
 #include "DasHLE/Emulated/JNI.h"
 
 #define REGISTER_FUNC_32(name) bridge->registerFunction<dashle::BITS_32, EmuJNI_##name>("EmuJNI_"#name)
@@ -9,28 +10,24 @@ using namespace dashle::emulated::jni;
 
 // JavaVM methods
 
-static jint EmuJNI_JavaVM_GetEnv(uaddr vm, uaddr env, jint version, bool is64Bits) {
+template <usize BITS>
+static jint EmuJNI_JavaVM_GetEnv(uaddr vm, uaddr env, jint version) {
     auto ctx = JNIContext::getInstance();
     uaddr virtualEnv = ctx->virtualEnv();
     if (ctx->virtualVM() != vm)
         virtualEnv = 0u;
 
-    DASHLE_ASSERT_WRAPPER_CONST(block, ctx->getMem()->blockFromVAddr(env));
-    DASHLE_ASSERT_WRAPPER_CONST(nativeAddr, host::memory::virtualToHost(*block, env));
-    if (is64Bits) {
-        *reinterpret_cast<u64*>(nativeAddr) = virtualEnv;
-    } else {
-        *reinterpret_cast<u32*>(nativeAddr) = virtualEnv;
-    }
-    return virtualEnv ? binary::jni::OK : binary::jni::DETACHED;
+    DASHLE_ASSERT_WRAPPER_CONST(envPtr, host::memory::GuestPtr<host::memory::GuestAddr<BITS>>::from(*ctx->getMem(), env));
+    *envPtr = virtualEnv;
+    return virtualEnv ? binary::jni::JNI_OK : binary::jni::JNI_EDETACHED;
 }
 
 static jint EmuJNI_JavaVM_GetEnv32(u32 vm, u32 env, jint version) {
-    return EmuJNI_JavaVM_GetEnv(vm, env, version, false);
+    return EmuJNI_JavaVM_GetEnv<dashle::BITS_32>(vm, env, version);
 }
 
 static jint EmuJNI_JavaVM_GetEnv64(u64 vm, u64 env, jint version)  {
-    return EmuJNI_JavaVM_GetEnv(vm, env, version, true);
+    return EmuJNI_JavaVM_GetEnv<dashle::BITS_64>(vm, env, version);
 }
 
 // JNIContext
@@ -0,0 +1,439 @@
+#include "DasHLE/Host/GuestPtr.h"
+#include "DasHLE/Host/Sync.h"
+#include "DasHLE/Emulated/Libc.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#define REGISTER_FUNC_32(name) bridge->registerFunction<dashle::BITS_32, EmuLibc_##name##32>(#name)
+#define REGISTER_FUNC_64(name) bridge->registerFunction<dashle::BITS_64, EmuLibc_##name##64>(#name)
+
+using namespace dashle;
+using namespace dashle::emulated::libc;
+
+// Memory allocation
+
+static uaddr EmuLibc_malloc(usize size) {
+    return LibcContext::getInstance()->getHeap()->allocate(size).value_or(0u);
+}
+
+static void EmuLibc_free(uaddr ptr) {
+    const auto ret = LibcContext::getInstance()->getHeap()->free(ptr);
+    if (!ret) {
+        DASHLE_UNREACHABLE("Invalid free (ptr=0x{:X})", ptr);
+    }
+}
+
+static uaddr EmuLibc_calloc(usize count, usize size) {
+    return LibcContext::getInstance()->getHeap()->allocateZeroed(count, size).value_or(0u);
+}
+
+static uaddr EmuLibc_realloc(uaddr ptr, usize size) {
+    return LibcContext::getInstance()->getHeap()->reallocate(ptr, size).value_or(0u);
+}
+
+static u32 EmuLibc_malloc32(u32 size) { return EmuLibc_malloc(size); }
+static u64 EmuLibc_malloc64(u64 size) { return EmuLibc_malloc(size); }
+static void EmuLibc_free32(u32 ptr) { EmuLibc_free(ptr); }
+static void EmuLibc_free64(u64 ptr) { EmuLibc_free(ptr); }
+static u32 EmuLibc_calloc32(u32 count, u32 size) { return EmuLibc_calloc(count, size); }
+static u64 EmuLibc_calloc64(u64 count, u64 size) { return EmuLibc_calloc(count, size); }
+static u32 EmuLibc_realloc32(u32 ptr, u32 size) { return EmuLibc_realloc(ptr, size); }
+static u64 EmuLibc_realloc64(u64 ptr, u64 size) { return EmuLibc_realloc(ptr, size); }
+
+// Threads
+
+// Guest error codes.
+constexpr static s32 GUEST_EPERM = 1;
+constexpr static s32 GUEST_ESRCH = 3;
+constexpr static s32 GUEST_EAGAIN = 11;
+constexpr static s32 GUEST_EINVAL = 22;
+constexpr static s32 GUEST_EDEADLK = 35;
+
+// Attributes are ignored, threads get the default stack size.
+template <usize BITS>
+static s32 EmuLibc_pthread_create(uaddr thread, uaddr attr, uaddr start, uaddr arg) {
+    const auto ctx = LibcContext::getInstance();
+    DASHLE_ASSERT_WRAPPER_CONST(threadPtr, host::memory::GuestPtr<host::memory::GuestAddr<BITS>>::from(*ctx->getMem(), thread));
+
+    const auto id = ctx->getThreads()->create(start, arg);
+    if (!id)
+        return GUEST_EAGAIN;
+
+    *threadPtr = id.value();
+    return 0;
+}
+
+template <usize BITS>
+static s32 EmuLibc_pthread_join(uaddr thread, uaddr ret) {
+    const auto ctx = LibcContext::getInstance();
+    if (thread == guest::ThreadManager::currentId())
+        return GUEST_EDEADLK;
+
+    const auto result = [&] {
+        guest::Scheduler::Blocking blocking;
+        return ctx->getThreads()->join(thread);
+    }();
+
+    if (!result)
+        return result.error() == Error::NotFound ? GUEST_ESRCH : GUEST_EINVAL;
+
+    if (ret) {
+        DASHLE_ASSERT_WRAPPER_CONST(retPtr, host::memory::GuestPtr<host::memory::GuestAddr<BITS>>::from(*ctx->getMem(), ret));
+        *retPtr = result.value();
+    }
+
+    return 0;
+}
+
+// Let other threads run first, the guest leaves the Jit once this returns.
+static s32 EmuLibc_sched_yield() {
+    const auto vm = guest::VM::current();
+    DASHLE_ASSERT(vm);
+    vm->halt(guest::halt::YIELD);
+    return 0;
+}
+
+static s32 EmuLibc_pthread_detach(uaddr thread) {
+    const auto ret = LibcContext::getInstance()->getThreads()->detach(thread);
+    if (!ret)
+        return ret.error() == Error::NotFound ? GUEST_ESRCH : GUEST_EINVAL;
+
+    return 0;
+}
+
+static s32 EmuLibc_pthread_create32(u32 thread, u32 attr, u32 start, u32 arg) { return EmuLibc_pthread_create<dashle::BITS_32>(thread, attr, start, arg); }
+static s32 EmuLibc_pthread_create64(u64 thread, u64 attr, u64 start, u64 arg) { return EmuLibc_pthread_create<dashle::BITS_64>(thread, attr, start, arg); }
+static s32 EmuLibc_pthread_join32(u32 thread, u32 ret) { return EmuLibc_pthread_join<dashle::BITS_32>(thread, ret); }
+static s32 EmuLibc_pthread_join64(u64 thread, u64 ret) { return EmuLibc_pthread_join<dashle::BITS_64>(thread, ret); }
+static s32 EmuLibc_pthread_detach32(u32 thread) { return EmuLibc_pthread_detach(thread); }
+static s32 EmuLibc_pthread_detach64(u64 thread) { return EmuLibc_pthread_detach(thread); }
+static u32 EmuLibc_pthread_self32() { return guest::ThreadManager::currentId(); }
+static u64 EmuLibc_pthread_self64() { return guest::ThreadManager::currentId(); }
+static s32 EmuLibc_sched_yield32() { return EmuLibc_sched_yield(); }
+static s32 EmuLibc_sched_yield64() { return EmuLibc_sched_yield(); }
+
+// Synchronization
+// Objects are operated on in place, through their first word.
+
+static u32& syncWord(uaddr vaddr) {
+    DASHLE_ASSERT_WRAPPER_CONST(ptr, host::memory::GuestPtr<u32>::from(*LibcContext::getInstance()->getMem(), vaddr));
+    return *ptr;
+}
+
+// Thread ids only grow and would eventually overflow the 16 bits of mutex owners, slots of running threads don't.
+static u32 mutexOwner() {
+    const auto slot = guest::ThreadManager::currentSlot();
+    DASHLE_ASSERT(slot < 0xFFFFu);
+    return static_cast<u32>(slot) + 1u;
+}
+
+static s32 syncError(Error error) {
+    switch (error) {
+        case Error::Duplicate:
+            return GUEST_EDEADLK;
+        case Error::InvalidSize:
+            return GUEST_EAGAIN;
+        case Error::PermissionDenied:
+            return GUEST_EPERM;
+        default:
+            return GUEST_EINVAL;
+    }
+}
+
+static s32 EmuLibc_pthread_mutex_init(uaddr mutex, uaddr attr) {
+    // Attributes hold the type in the low bits, process shared mutexes are treated as private ones.
+    constexpr u32 ATTR_TYPE_MASK = 0xFu;
+    constexpr u32 ATTR_TYPES[] = { host::sync::mutex::TYPE_NORMAL, host::sync::mutex::TYPE_RECURSIVE, host::sync::mutex::TYPE_ERRORCHECK };
+
+    auto type = host::sync::mutex::TYPE_NORMAL;
+    if (attr) {
+        const auto attrType = syncWord(attr) & ATTR_TYPE_MASK;
+        if (attrType >= std::size(ATTR_TYPES))
+            return GUEST_EINVAL;
+
+        type = ATTR_TYPES[attrType];
+    }
+
+    host::sync::mutexInit(syncWord(mutex), type);
+    return 0;
+}
+
+static s32 EmuLibc_pthread_mutex_destroy(uaddr mutex) { return 0; }
+
+static s32 EmuLibc_pthread_mutex_lock(uaddr mutex) {
+    const auto ret = host::sync::mutexLock(syncWord(mutex), mutexOwner());
+    return ret ? 0 : syncError(ret.error());
+}
+
+static s32 EmuLibc_pthread_mutex_unlock(uaddr mutex) {
+    const auto ret = host::sync::mutexUnlock(syncWord(mutex), mutexOwner());
+    return ret ? 0 : syncError(ret.error());
+}
+
+static s32 EmuLibc_pthread_cond_init(uaddr cond, uaddr attr) {
+    host::sync::condInit(syncWord(cond));
+    return 0;
+}
+
+static s32 EmuLibc_pthread_cond_destroy(uaddr cond) { return 0; }
+
+static s32 EmuLibc_pthread_cond_signal(uaddr cond) {
+    host::sync::condSignal(syncWord(cond));
+    return 0;
+}
+
+static s32 EmuLibc_pthread_cond_broadcast(uaddr cond) {
+    host::sync::condBroadcast(syncWord(cond));
+    return 0;
+}
+
+static s32 EmuLibc_pthread_cond_wait(uaddr cond, uaddr mutex) {
+    const auto ret = host::sync::condWait(syncWord(cond), syncWord(mutex), mutexOwner());
+    return ret ? 0 : syncError(ret.error());
+}
+
+// Semaphores return -1 and set errno on failure, errno is not emulated yet.
+static s32 EmuLibc_sem_init(uaddr sem, s32 shared, u32 value) {
+    if (value > static_cast<u32>(std::numeric_limits<s32>::max()))
+        return -1;
+
+    host::sync::semInit(syncWord(sem), value);
+    return 0;
+}
+
+static s32 EmuLibc_sem_destroy(uaddr sem) { return 0; }
+
+static s32 EmuLibc_sem_wait(uaddr sem) {
+    host::sync::semWait(syncWord(sem));
+    return 0;
+}
+
+static s32 EmuLibc_sem_post(uaddr sem) {
+    return host::sync::semPost(syncWord(sem)) ? 0 : -1;
+}
+
+static s32 EmuLibc_pthread_mutex_init32(u32 mutex, u32 attr) { return EmuLibc_pthread_mutex_init(mutex, attr); }
+static s32 EmuLibc_pthread_mutex_init64(u64 mutex, u64 attr) { return EmuLibc_pthread_mutex_init(mutex, attr); }
+static s32 EmuLibc_pthread_mutex_destroy32(u32 mutex) { return EmuLibc_pthread_mutex_destroy(mutex); }
+static s32 EmuLibc_pthread_mutex_destroy64(u64 mutex) { return EmuLibc_pthread_mutex_destroy(mutex); }
+static s32 EmuLibc_pthread_mutex_lock32(u32 mutex) { return EmuLibc_pthread_mutex_lock(mutex); }
+static s32 EmuLibc_pthread_mutex_lock64(u64 mutex) { return EmuLibc_pthread_mutex_lock(mutex); }
+static s32 EmuLibc_pthread_mutex_unlock32(u32 mutex) { return EmuLibc_pthread_mutex_unlock(mutex); }
+static s32 EmuLibc_pthread_mutex_unlock64(u64 mutex) { return EmuLibc_pthread_mutex_unlock(mutex); }
+static s32 EmuLibc_pthread_cond_init32(u32 cond, u32 attr) { return EmuLibc_pthread_cond_init(cond, attr); }
+static s32 EmuLibc_pthread_cond_init64(u64 cond, u64 attr) { return EmuLibc_pthread_cond_init(cond, attr); }
+static s32 EmuLibc_pthread_cond_destroy32(u32 cond) { return EmuLibc_pthread_cond_destroy(cond); }
+static s32 EmuLibc_pthread_cond_destroy64(u64 cond) { return EmuLibc_pthread_cond_destroy(cond); }
+static s32 EmuLibc_pthread_cond_signal32(u32 cond) { return EmuLibc_pthread_cond_signal(cond); }
+static s32 EmuLibc_pthread_cond_signal64(u64 cond) { return EmuLibc_pthread_cond_signal(cond); }
+static s32 EmuLibc_pthread_cond_broadcast32(u32 cond) { return EmuLibc_pthread_cond_broadcast(cond); }
+static s32 EmuLibc_pthread_cond_broadcast64(u64 cond) { return EmuLibc_pthread_cond_broadcast(cond); }
+static s32 EmuLibc_pthread_cond_wait32(u32 cond, u32 mutex) { return EmuLibc_pthread_cond_wait(cond, mutex); }
+static s32 EmuLibc_pthread_cond_wait64(u64 cond, u64 mutex) { return EmuLibc_pthread_cond_wait(cond, mutex); }
+static s32 EmuLibc_sem_init32(u32 sem, s32 shared, u32 value) { return EmuLibc_sem_init(sem, shared, value); }
+static s32 EmuLibc_sem_init64(u64 sem, s32 shared, u32 value) { return EmuLibc_sem_init(sem, shared, value); }
+static s32 EmuLibc_sem_destroy32(u32 sem) { return EmuLibc_sem_destroy(sem); }
+static s32 EmuLibc_sem_destroy64(u64 sem) { return EmuLibc_sem_destroy(sem); }
+static s32 EmuLibc_sem_wait32(u32 sem) { return EmuLibc_sem_wait(sem); }
+static s32 EmuLibc_sem_wait64(u64 sem) { return EmuLibc_sem_wait(sem); }
+static s32 EmuLibc_sem_post32(u32 sem) { return EmuLibc_sem_post(sem); }
+static s32 EmuLibc_sem_post64(u64 sem) { return EmuLibc_sem_post(sem); }
+
+// Thread local storage
+
+// Slots of the calling thread, translated once and cached until the memory layout changes.
+template <usize BITS>
+static host::memory::GuestAddr<BITS>* tlsSlots() {
+    struct Cache {
+        uaddr base = 0u;
+        u64 generation = 0u;
+        host::memory::GuestAddr<BITS>* slots = nullptr;
+    };
+
+    static thread_local Cache cache;
+    const auto vm = guest::VM::current();
+    DASHLE_ASSERT(vm);
+
+    const auto mem = LibcContext::getInstance()->getMem();
+    const auto generation = mem->generation();
+    if (cache.base != vm->tlsBase() || cache.generation != generation) {
+        DASHLE_ASSERT_WRAPPER_CONST(span, host::memory::GuestSpan<host::memory::GuestAddr<BITS>>::from(*mem, vm->tlsBase(), guest::TLS_SLOTS));
+        cache = Cache { .base = vm->tlsBase(), .generation = generation, .slots = span.data() };
+    }
+
+    return cache.slots;
+}
+
+// Destructors are not run on thread exit.
+template <usize BITS>
+static s32 EmuLibc_pthread_key_create(uaddr key, uaddr destructor) {
+    const auto ctx = LibcContext::getInstance();
+    DASHLE_ASSERT_WRAPPER_CONST(keyPtr, host::memory::GuestPtr<u32>::from(*ctx->getMem(), key));
+
+    const auto slot = ctx->allocateTLSKey();
+    if (!slot)
+        return GUEST_EAGAIN;
+
+    *keyPtr = slot.value();
+    return 0;
+}
+
+static s32 EmuLibc_pthread_key_delete(u32 key) {
+    return LibcContext::getInstance()->freeTLSKey(key) ? 0 : GUEST_EINVAL;
+}
+
+template <usize BITS>
+static uaddr EmuLibc_pthread_getspecific(u32 key) {
+    if (key >= guest::TLS_SLOTS)
+        return 0u;
+
+    return tlsSlots<BITS>()[key];
+}
+
+template <usize BITS>
+static s32 EmuLibc_pthread_setspecific(u32 key, uaddr value) {
+    if (key < guest::TLS_FIRST_KEY || key >= guest::TLS_SLOTS)
+        return GUEST_EINVAL;
+
+    tlsSlots<BITS>()[key] = value;
+    return 0;
+}
+
+static s32 EmuLibc_pthread_key_create32(u32 key, u32 destructor) { return EmuLibc_pthread_key_create<dashle::BITS_32>(key, destructor); }
+static s32 EmuLibc_pthread_key_create64(u64 key, u64 destructor) { return EmuLibc_pthread_key_create<dashle::BITS_64>(key, destructor); }
+static s32 EmuLibc_pthread_key_delete32(u32 key) { return EmuLibc_pthread_key_delete(key); }
+static s32 EmuLibc_pthread_key_delete64(u32 key) { return EmuLibc_pthread_key_delete(key); }
+static u32 EmuLibc_pthread_getspecific32(u32 key) { return EmuLibc_pthread_getspecific<dashle::BITS_32>(key); }
+static u64 EmuLibc_pthread_getspecific64(u32 key) { return EmuLibc_pthread_getspecific<dashle::BITS_64>(key); }
+static s32 EmuLibc_pthread_setspecific32(u32 key, u32 value) { return EmuLibc_pthread_setspecific<dashle::BITS_32>(key, value); }
+static s32 EmuLibc_pthread_setspecific64(u32 key, u64 value) { return EmuLibc_pthread_setspecific<dashle::BITS_64>(key, value); }
+
+// Sorting
+
+// Elements stay in place while the guest comparator runs, then they are moved once in sorted order.
+static void EmuLibc_qsort(uaddr base, usize count, usize size, uaddr compare) {
+    if (count < 2u || !size)
+        return;
+
+    const auto vm = guest::VM::current();
+    DASHLE_ASSERT(vm);
+
+    std::vector<usize> order(count);
+    std::iota(order.begin(), order.end(), 0u);
+    // Guest comparators may not be a strict weak ordering, which std::sort can walk out of bounds on.
+    std::stable_sort(order.begin(), order.end(), [=](usize a, usize b) {
+        DASHLE_ASSERT_WRAPPER_CONST(result, vm->call(compare, base + a * size, base + b * size));
+        return static_cast<s32>(result) < 0;
+    });
+
+    // Comparators may change the memory layout, translate afterwards.
+    DASHLE_ASSERT_WRAPPER_CONST(elements, host::memory::GuestSpan<u8>::from(*LibcContext::getInstance()->getMem(), base, count * size));
+    std::vector<u8> sorted(count * size);
+    for (auto i = 0u; i < count; ++i)
+        std::memcpy(sorted.data() + i * size, elements.data() + order[i] * size, size);
+
+    std::memcpy(elements.data(), sorted.data(), sorted.size());
+}
+
+static void EmuLibc_qsort32(u32 base, u32 count, u32 size, u32 compare) { EmuLibc_qsort(base, count, size, compare); }
+static void EmuLibc_qsort64(u64 base, u64 count, u64 size, u64 compare) { EmuLibc_qsort(base, count, size, compare); }
+
+// LibcContext
+
+Expected<usize> LibcContext::allocateTLSKey() {
+    constexpr u64 RESERVED_MASK = (static_cast<u64>(1u) << guest::TLS_FIRST_KEY) - 1u;
+
+    auto keys = m_TLSKeys.load(std::memory_order_relaxed);
+    while (true) {
+        const auto free = ~(keys | RESERVED_MASK);
+        if (!free)
+            return Unexpected(Error::NotFound);
+
+        const auto key = static_cast<usize>(std::countr_zero(free));
+        if (m_TLSKeys.compare_exchange_weak(keys, keys | (static_cast<u64>(1u) << key), std::memory_order_relaxed))
+            return key;
+    }
+}
+
+Expected<void> LibcContext::freeTLSKey(usize key) {
+    if (key < guest::TLS_FIRST_KEY || key >= guest::TLS_SLOTS)
+        return Unexpected(Error::InvalidIndex);
+
+    const auto mask = static_cast<u64>(1u) << key;
+    if (!(m_TLSKeys.fetch_and(~mask, std::memory_order_relaxed) & mask))
+        return Unexpected(Error::NotFound);
+
+    return EXPECTED_VOID;
+}
+
+void LibcContext::populateBridge(host::bridge::Bridge* bridge) {
+    // Memory allocation.
+    REGISTER_FUNC_32(malloc);
+    REGISTER_FUNC_64(malloc);
+    REGISTER_FUNC_32(free);
+    REGISTER_FUNC_64(free);
+    REGISTER_FUNC_32(calloc);
+    REGISTER_FUNC_64(calloc);
+    REGISTER_FUNC_32(realloc);
+    REGISTER_FUNC_64(realloc);
+
+    // Threads.
+    REGISTER_FUNC_32(pthread_create);
+    REGISTER_FUNC_64(pthread_create);
+    REGISTER_FUNC_32(pthread_join);
+    REGISTER_FUNC_64(pthread_join);
+    REGISTER_FUNC_32(pthread_detach);
+    REGISTER_FUNC_64(pthread_detach);
+    REGISTER_FUNC_32(pthread_self);
+    REGISTER_FUNC_64(pthread_self);
+    REGISTER_FUNC_32(sched_yield);
+    REGISTER_FUNC_64(sched_yield);
+
+    // Thread local storage.
+    REGISTER_FUNC_32(pthread_key_create);
+    REGISTER_FUNC_64(pthread_key_create);
+    REGISTER_FUNC_32(pthread_key_delete);
+    REGISTER_FUNC_64(pthread_key_delete);
+    REGISTER_FUNC_32(pthread_getspecific);
+    REGISTER_FUNC_64(pthread_getspecific);
+    REGISTER_FUNC_32(pthread_setspecific);
+    REGISTER_FUNC_64(pthread_setspecific);
+
+    // Synchronization.
+    REGISTER_FUNC_32(pthread_mutex_init);
+    REGISTER_FUNC_64(pthread_mutex_init);
+    REGISTER_FUNC_32(pthread_mutex_destroy);
+    REGISTER_FUNC_64(pthread_mutex_destroy);
+    REGISTER_FUNC_32(pthread_mutex_lock);
+    REGISTER_FUNC_64(pthread_mutex_lock);
+    REGISTER_FUNC_32(pthread_mutex_unlock);
+    REGISTER_FUNC_64(pthread_mutex_unlock);
+    REGISTER_FUNC_32(pthread_cond_init);
+    REGISTER_FUNC_64(pthread_cond_init);
+    REGISTER_FUNC_32(pthread_cond_destroy);
+    REGISTER_FUNC_64(pthread_cond_destroy);
+    REGISTER_FUNC_32(pthread_cond_signal);
+    REGISTER_FUNC_64(pthread_cond_signal);
+    REGISTER_FUNC_32(pthread_cond_broadcast);
+    REGISTER_FUNC_64(pthread_cond_broadcast);
+    REGISTER_FUNC_32(pthread_cond_wait);
+    REGISTER_FUNC_64(pthread_cond_wait);
+    REGISTER_FUNC_32(sem_init);
+    REGISTER_FUNC_64(sem_init);
+    REGISTER_FUNC_32(sem_destroy);
+    REGISTER_FUNC_64(sem_destroy);
+    REGISTER_FUNC_32(sem_wait);
+    REGISTER_FUNC_64(sem_wait);
+    REGISTER_FUNC_32(sem_post);
+    REGISTER_FUNC_64(sem_post);
+
+    // Sorting.
+    REGISTER_FUNC_32(qsort);
+    REGISTER_FUNC_64(qsort);
+}
@@ -0,0 +1,59 @@
+#ifndef _DASHLE_EMULATED_LIBC_H
+#define _DASHLE_EMULATED_LIBC_H
+
+#include "DasHLE/Host/Heap.h"
+#include "DasHLE/Host/Bridge.h"
+#include "DasHLE/Guest/Threads.h"
+
+#include <atomic>
+#include <memory>
+
+namespace dashle::emulated::libc {
+
+class LibcContext final {
+    std::shared_ptr<host::memory::MemoryManager> m_Mem;
+    std::shared_ptr<host::heap::GuestHeap> m_Heap;
+    std::shared_ptr<guest::ThreadManager> m_Threads;
+    std::atomic<u64> m_TLSKeys = 0u; // Bitmap of the TLS slots handed out as pthread keys.
+
+    static_assert(guest::TLS_SLOTS <= 64u);
+
+    LibcContext() {}
+
+public:
+    static LibcContext* getInstance() {
+        static LibcContext ctx;
+        return &ctx;
+    }
+
+    static void populateBridge(host::bridge::Bridge* bridge);
+
+    void setMem(std::shared_ptr<host::memory::MemoryManager> mem) { m_Mem = mem; }
+
+    host::memory::MemoryManager* getMem() {
+        DASHLE_ASSERT(m_Mem);
+        return m_Mem.get();
+    }
+
+    void setHeap(std::shared_ptr<host::heap::GuestHeap> heap) { m_Heap = heap; }
+
+    host::heap::GuestHeap* getHeap() {
+        DASHLE_ASSERT(m_Heap);
+        return m_Heap.get();
+    }
+
+    void setThreads(std::shared_ptr<guest::ThreadManager> threads) { m_Threads = threads; }
+
+    guest::ThreadManager* getThreads() {
+        DASHLE_ASSERT(m_Threads);
+        return m_Threads.get();
+    }
+
+    // Hand out a TLS slot, keys are shared by every thread.
+    Expected<usize> allocateTLSKey();
+    Expected<void> freeTLSKey(usize key);
+};
+
+} // namespace dashle::emulated::libc
+
+#endif /* _DASHLE_EMULATED_LIBC_H */
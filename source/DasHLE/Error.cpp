@@ -27,6 +27,7 @@ std::string dashle::errorAsString(Error error) {
         ERROR_CASE(InvalidArgument);
         ERROR_CASE(Duplicate);
         ERROR_CASE(InvalidOperation);
+        ERROR_CASE(PermissionDenied);
     }
 
 #undef ERROR_CASE
@@ -1,10 +1,21 @@
 #include "DasHLE/Support/Math.h"
 #include "DasHLE/Guest/ARM/ARM.h"
 
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <mutex>
+
 using namespace dashle;
 using namespace dashle::guest;
 using namespace dashle::guest::arm;
 
+// Serializes the creation of Jits, so that a new code cache can't be mistaken for the one of another VM.
+static std::mutex g_JitLock;
+
+// Dynarmic maps its code caches writable and executable.
+constexpr static usize CODE_CACHE_PERMS = host::memory::flags::PERM_WRITE | host::memory::flags::PERM_EXEC;
+
 // START DEBUG
 static std::string getPermString(usize flags) {
     std::string permString("---");
@@ -25,49 +36,137 @@ static std::string getPermString(usize flags) {
 // Environment
 
 struct ARMVM::Environment final : public dynarmic32::UserCallbacks {
+    // Direct mapped TLB in front of the block lookup. Entries are tagged with the memory generation,
+    // so any change in the memory layout invalidates them without having to flush the table.
+    struct TLBEntry {
+        uaddr page = 0u;
+        uaddr hostDelta = 0u;
+        usize flags = 0u;
+        u64 generation = 0u;
+    };
+
+    constexpr static usize TLB_PAGE_BITS = 12u;
+    constexpr static usize TLB_PAGE_SIZE = static_cast<usize>(1u) << TLB_PAGE_BITS;
+    constexpr static usize TLB_SIZE = 256u;
+
     std::shared_ptr<host::memory::MemoryManager> m_Mem;
     std::shared_ptr<host::bridge::Bridge> m_Bridge;
+    std::array<TLBEntry, TLB_SIZE> m_TLB = {};
+    host::bridge::GuestContext32 m_CallContext;
+    dynarmic32::Jit* m_Jit = nullptr;
+    uaddr m_EndExecVAddr = 0u;
+    u64 m_TicksRemaining = 0u;
+    BlockCounters::Table* m_BlockCounters = nullptr; // Shared by every level.
 
     Environment(std::shared_ptr<host::memory::MemoryManager> mem, std::shared_ptr<host::bridge::Bridge> bridge)
         : m_Mem(mem), m_Bridge(bridge) {
         DASHLE_ASSERT(m_Mem);
         DASHLE_ASSERT(m_Bridge);
+        m_CallContext.mem = m_Mem.get();
     }
     
     virtual ~Environment() noexcept {}
 
     Expected<uaddr> virtualToHost(uaddr vaddr) const {
         DASHLE_ASSERT(m_Mem);
-        return m_Mem->blockFromVAddr(vaddr).and_then([vaddr](const host::memory::AllocatedBlock* block) {
-            return host::memory::virtualToHost(*block, vaddr);
+        return m_Mem->blockFromVAddr(vaddr).and_then([vaddr](const host::memory::AllocatedBlock& block) {
+            return host::memory::virtualToHost(block, vaddr);
         });
     }
 
-    Expected<uaddr> virtualToHostChecked(uaddr vaddr, usize flags) const {
+    Expected<host::memory::AllocatedBlock> blockChecked(uaddr vaddr, usize flags) const {
         constexpr bool verbose = true;
+        const auto block = m_Mem->blockFromVAddr(vaddr);
         if constexpr(dashle::DEBUG_MODE) {
             flags &= host::memory::flags::PERM_MASK;
-            const auto block = m_Mem->blockFromVAddr(vaddr);
             if (verbose && !block) {
                 DASHLE_LOG_LINE("Block not found (vaddr=0x{:X}, expected={})", vaddr, getPermString(flags));
                 DASHLE_LOG_LINE("Gonna assert wawa");
             }
             DASHLE_ASSERT(block);
-            if (verbose && !(block.value()->flags & flags)) {
-                DASHLE_LOG_LINE("Invalid flags (expected={}, found={})", getPermString(flags), getPermString(block.value()->flags));
+            if (verbose && !(block->flags & flags)) {
+                DASHLE_LOG_LINE("Invalid flags (expected={}, found={})", getPermString(flags), getPermString(block->flags));
                 DASHLE_LOG_LINE("Trying to access 0x{:X}", vaddr);
                 DASHLE_LOG_LINE("Gonna assert wawa");
             }
-            DASHLE_ASSERT(block.value()->flags & flags);
+            DASHLE_ASSERT(block->flags & flags);
         }
 
-        return virtualToHost(vaddr);
+        return block;
+    }
+
+    Expected<uaddr> virtualToHostChecked(uaddr vaddr, usize flags) const {
+        return blockChecked(vaddr, flags).and_then([vaddr](const host::memory::AllocatedBlock& block) {
+            return host::memory::virtualToHost(block, vaddr);
+        });
+    }
+
+    template <typename T>
+    Expected<uaddr> virtualToHostCached(uaddr vaddr, usize flags) {
+        const auto page = vaddr >> TLB_PAGE_BITS;
+        const auto generation = m_Mem->generation();
+        auto& entry = m_TLB[page % TLB_SIZE];
+
+        // Accesses crossing a page boundary may span different blocks.
+        if (entry.page == page && entry.generation == generation && (entry.flags & flags)
+            && (vaddr & (TLB_PAGE_SIZE - 1)) + sizeof(T) <= TLB_PAGE_SIZE)
+            return vaddr + entry.hostDelta;
+
+        DASHLE_TRY_EXPECTED_CONST(block, blockChecked(vaddr, flags));
+
+        // Only cache pages fully covered by the block.
+        const auto pageBase = page << TLB_PAGE_BITS;
+        if (block.virtualBase <= pageBase && (pageBase + TLB_PAGE_SIZE) <= (block.virtualBase + block.size)) {
+            entry = TLBEntry {
+                .page = page,
+                .hostDelta = block.hostBase - block.virtualBase,
+                .flags = block.flags,
+                .generation = generation,
+            };
+        }
+
+        return host::memory::virtualToHost(block, vaddr);
+    }
+
+    template <typename T>
+    T memoryRead(uaddr vaddr) {
+        DASHLE_ASSERT_WRAPPER_CONST(addr, virtualToHostCached<T>(vaddr, host::memory::flags::PERM_READ));
+        return *reinterpret_cast<const T*>(addr);
+    }
+
+    template <typename T>
+    void memoryWrite(uaddr vaddr, T value) {
+        DASHLE_ASSERT_WRAPPER_CONST(addr, virtualToHostCached<T>(vaddr, host::memory::flags::PERM_WRITE));
+        *reinterpret_cast<T*>(addr) = value;
     }
 
     /* Dynarmic callbacks */
 
+    static void returnToHost(u64 jit) {
+        reinterpret_cast<dynarmic32::Jit*>(jit)->HaltExecution(halt::RETURNED);
+    }
+
+    // The IR can't access host memory, the counter is bumped by a host call.
+    static void countBlock(u64 counter) {
+        ++*reinterpret_cast<u64*>(counter);
+    }
+
     bool PreCodeReadHook(bool isThumb, dynarmic32::VAddr pc, dynarmic32::IREmitter& ir) override {
-        return !m_Bridge->emitCall(pc, &ir);
+        // The dispatcher sees the halt before running anything else, PC stays on the end address.
+        if ((pc - m_EndExecVAddr) < MAX_CALL_DEPTH * 4u) {
+            ir.CallHostFunction(&returnToHost, ir.Imm64(reinterpret_cast<u64>(m_Jit)));
+            ir.SetTerm(dynarmic_ir::Term::ReturnToDispatch{});
+            return false;
+        }
+
+        if (m_Bridge->isIFTAddress(pc) && m_Bridge->emitCall(pc, &ir, &m_CallContext))
+            return false;
+
+        // Called for every instruction, only count on the first one of the block. Translation carries on after it.
+        if (m_BlockCounters && pc == dynarmic32::LocationDescriptor(ir.block.Location()).PC())
+            ir.CallHostFunction(&countBlock, ir.Imm64(reinterpret_cast<u64>(m_BlockCounters->counter(isThumb ? pc | 1u : pc))));
+
+        return true;
     }
 
     std::optional<std::uint32_t> MemoryReadCode(dynarmic32::VAddr vaddr) override {
@@ -79,73 +178,67 @@ struct ARMVM::Environment final : public dynarmic32::UserCallbacks {
     }
 
     std::uint8_t MemoryRead8(dynarmic32::VAddr vaddr) override {
-        DASHLE_ASSERT_WRAPPER_CONST(addr, virtualToHostChecked(vaddr, host::memory::flags::PERM_READ));
-        return *reinterpret_cast<const std::uint8_t*>(addr);
+        return memoryRead<std::uint8_t>(vaddr);
     }
 
     std::uint16_t MemoryRead16(dynarmic32::VAddr vaddr) override {
-        DASHLE_ASSERT_WRAPPER_CONST(addr, virtualToHostChecked(vaddr, host::memory::flags::PERM_READ));
-        return *reinterpret_cast<const std::uint16_t*>(addr);
+        return memoryRead<std::uint16_t>(vaddr);
     }
 
     std::uint32_t MemoryRead32(dynarmic32::VAddr vaddr) override {
-        DASHLE_ASSERT_WRAPPER_CONST(addr, virtualToHostChecked(vaddr, host::memory::flags::PERM_READ));
-        return *reinterpret_cast<const std::uint32_t*>(addr);
+        return memoryRead<std::uint32_t>(vaddr);
     }
 
     std::uint64_t MemoryRead64(dynarmic32::VAddr vaddr) override {
-        DASHLE_ASSERT_WRAPPER_CONST(addr, virtualToHostChecked(vaddr, host::memory::flags::PERM_READ));
-        return *reinterpret_cast<const std::uint64_t*>(addr);
+        return memoryRead<std::uint64_t>(vaddr);
     }
 
     void MemoryWrite8(dynarmic32::VAddr vaddr, std::uint8_t value) override {
-        DASHLE_ASSERT_WRAPPER_CONST(addr, virtualToHostChecked(vaddr, host::memory::flags::PERM_WRITE));
-        *reinterpret_cast<std::uint8_t*>(addr) = value;
+        memoryWrite<std::uint8_t>(vaddr, value);
     }
 
     void MemoryWrite16(dynarmic32::VAddr vaddr, std::uint16_t value) override {
-        DASHLE_ASSERT_WRAPPER_CONST(addr, virtualToHostChecked(vaddr, host::memory::flags::PERM_WRITE));
-        *reinterpret_cast<std::uint16_t*>(addr) = value;
+        memoryWrite<std::uint16_t>(vaddr, value);
     }
 
     void MemoryWrite32(dynarmic32::VAddr vaddr, std::uint32_t value) override {
-        DASHLE_ASSERT_WRAPPER_CONST(addr, virtualToHostChecked(vaddr, host::memory::flags::PERM_WRITE));
-        *reinterpret_cast<std::uint32_t*>(addr) = value;
+        memoryWrite<std::uint32_t>(vaddr, value);
     }
         
     void MemoryWrite64(dynarmic32::VAddr vaddr, std::uint64_t value) override {
-        DASHLE_ASSERT_WRAPPER_CONST(addr, virtualToHostChecked(vaddr, host::memory::flags::PERM_WRITE));
-        *reinterpret_cast<std::uint64_t*>(addr) = value;
+        memoryWrite<std::uint64_t>(vaddr, value);
+    }
+
+    // Called by the monitor while the reservation is held, the CAS also catches plain stores made meanwhile
+    // by other threads.
+    template <typename T>
+    bool memoryWriteExclusive(uaddr vaddr, T value, T expected) {
+        DASHLE_ASSERT_WRAPPER_CONST(addr, virtualToHostCached<T>(vaddr, host::memory::flags::PERM_WRITE));
+        // Unaligned exclusive accesses raise an alignment fault on ARM.
+        DASHLE_ASSERT(!(addr % sizeof(T)));
+        return std::atomic_ref<T>(*reinterpret_cast<T*>(addr)).compare_exchange_strong(expected, value, std::memory_order_seq_cst);
     }
 
     bool MemoryWriteExclusive8(dynarmic32::VAddr vaddr, std::uint8_t value, std::uint8_t expected) override {
-        // TODO
-        MemoryWrite8(vaddr, value);
-        return true;
+        return memoryWriteExclusive<std::uint8_t>(vaddr, value, expected);
     }
 
     bool MemoryWriteExclusive16(dynarmic32::VAddr vaddr, std::uint16_t value, std::uint16_t expected) override {
-        // TODO
-        MemoryWrite16(vaddr, value);
-        return true;
+        return memoryWriteExclusive<std::uint16_t>(vaddr, value, expected);
     }
 
     bool MemoryWriteExclusive32(dynarmic32::VAddr vaddr, std::uint32_t value, std::uint32_t expected) override {
-        // TODO
-        MemoryWrite32(vaddr, value);
-        return true;
+        return memoryWriteExclusive<std::uint32_t>(vaddr, value, expected);
     }
 
     bool MemoryWriteExclusive64(dynarmic32::VAddr vaddr, std::uint64_t value, std::uint64_t expected) override {
-        // TODO
-        MemoryWrite64(vaddr, value);
-        return true;
+        return memoryWriteExclusive<std::uint64_t>(vaddr, value, expected);
     }
 
     bool IsReadOnlyMemory(dynarmic32::VAddr vaddr) override {
         DASHLE_ASSERT(m_Mem);
         if (auto block = m_Mem->blockFromVAddr(vaddr))
-            return !(block.value()->flags & host::memory::flags::PERM_WRITE);
+            return !(block->flags & host::memory::flags::PERM_WRITE);
                 
         return false;
     }
@@ -163,14 +256,88 @@ struct ARMVM::Environment final : public dynarmic32::UserCallbacks {
         DASHLE_UNREACHABLE("Unimplemented exception handling (pc=0x{:X}, exception={})", pc, static_cast<u32>(exception));
     }
 
-    void AddTicks(std::uint64_t ticks) override {}
-    std::uint64_t GetTicksRemaining() override { return 0; }
+    // Only called with cycle counting, the Jit returns once the quantum is over.
+    void AddTicks(std::uint64_t ticks) override {
+        m_TicksRemaining -= std::min<u64>(ticks, m_TicksRemaining);
+    }
+
+    std::uint64_t GetTicksRemaining() override { return m_TicksRemaining; }
+};
+
+// CP15
+
+// Only the thread ID registers and the legacy barrier operations are supported.
+// Registers are handed to the Jit by address, so reading the thread pointer compiles to a single load.
+class ARMVM::CP15 final : public dynarmic32::Coprocessor {
+    using CoprocReg = dynarmic32::CoprocReg;
+
+    u32 m_TPIDRURW = 0u; // User read/write thread ID.
+    u32 m_TPIDRURO = 0u; // User read only thread ID, the thread pointer.
+
+    static std::uint64_t barrier(void*, std::uint64_t, std::uint64_t) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return 0u;
+    }
+
+    bool isThreadID(bool two, unsigned opc1, CoprocReg CRn, CoprocReg CRm) const {
+        return !two && !opc1 && CRn == CoprocReg::C13 && CRm == CoprocReg::C0;
+    }
+
+public:
+    CP15(u32 threadPointer) : m_TPIDRURO(threadPointer) {}
+
+    std::optional<Callback> CompileInternalOperation(bool two, unsigned opc1, CoprocReg CRd, CoprocReg CRn, CoprocReg CRm, unsigned opc2) override {
+        return {};
+    }
+
+    CallbackOrAccessOneWord CompileSendOneWord(bool two, unsigned opc1, CoprocReg CRn, CoprocReg CRm, unsigned opc2) override {
+        if (isThreadID(two, opc1, CRn, CRm) && opc2 == 2u)
+            return &m_TPIDRURW;
+
+        // CP15ISB, CP15DSB and CP15DMB.
+        if (!two && !opc1 && CRn == CoprocReg::C7 && ((CRm == CoprocReg::C5 && opc2 == 4u) || (CRm == CoprocReg::C10 && (opc2 == 4u || opc2 == 5u))))
+            return Callback { .function = &barrier, .user_arg = {} };
+
+        return {};
+    }
+
+    CallbackOrAccessTwoWords CompileSendTwoWords(bool two, unsigned opc, CoprocReg CRm) override {
+        return {};
+    }
+
+    CallbackOrAccessOneWord CompileGetOneWord(bool two, unsigned opc1, CoprocReg CRn, CoprocReg CRm, unsigned opc2) override {
+        if (isThreadID(two, opc1, CRn, CRm)) {
+            if (opc2 == 2u)
+                return &m_TPIDRURW;
+
+            if (opc2 == 3u)
+                return &m_TPIDRURO;
+        }
+
+        return {};
+    }
+
+    CallbackOrAccessTwoWords CompileGetTwoWords(bool two, unsigned opc, CoprocReg CRm) override {
+        return {};
+    }
+
+    std::optional<Callback> CompileLoadWords(bool two, bool long_transfer, CoprocReg CRd, std::optional<std::uint8_t> option) override {
+        return {};
+    }
+
+    std::optional<Callback> CompileStoreWords(bool two, bool long_transfer, CoprocReg CRd, std::optional<std::uint8_t> option) override {
+        return {};
+    }
 };
 
 // ARMVM
 
+// Size of the address space reachable by the guest.
+constexpr static usize ADDRESS_SPACE_SIZE = static_cast<usize>(1u) << 32;
+
 constexpr static u32 cpsrThumbEnable(u32 cpsr) { return cpsr | 0x30u; }
 constexpr static u32 cpsrThumbDisable(u32 cpsr) { return cpsr & ~(0x30u); }
+constexpr static bool cpsrIsThumb(u32 cpsr) { return cpsr & 0x20u; }
 constexpr static bool isThumb(u32 addr) { return addr & 1u; }
 constexpr static u32 clearThumb(u32 addr) { return addr & ~(1u); }
 
@@ -181,27 +348,83 @@ void ARMVM::setPC(uaddr addr) {
     m_Jit->Regs()[regs::PC] = clearThumb(addr);
 }
 
-ARMVM::ARMVM(std::shared_ptr<host::memory::MemoryManager> mem, std::shared_ptr<host::bridge::Bridge> bridge, GuestVersion version)
-    : m_Mem(mem) {
+void ARMVM::adviseHugeCodeCache(const std::vector<std::pair<uaddr, usize>>& oldMappings, usize codeCacheSize) {
+    // Other threads may map memory meanwhile, only trust a single new mapping of the expected size.
+    DASHLE_ASSERT_WRAPPER_CONST(expectedSize, dashle::alignUp(codeCacheSize, host::memory::hostPageSize()));
+    usize newMappings = 0u;
+    Optional<std::pair<uaddr, usize>> codeCache;
+    for (const auto& mapping : host::memory::hostMappings(CODE_CACHE_PERMS)) {
+        if (std::find(oldMappings.begin(), oldMappings.end(), mapping) != oldMappings.end())
+            continue;
+
+        ++newMappings;
+        if (mapping.second == expectedSize)
+            codeCache = mapping;
+    }
+
+    if (newMappings != 1u || !codeCache)
+        return;
+
+    host::memory::adviseHugePages(codeCache->first, codeCache->second);
+    m_CodeCache.push_back(codeCache.value());
+}
+
+dynarmic32::Jit* ARMVM::createLevel(usize depth, const dynarmic32::UserConfig& cfg, bool hugeCodeCache) {
+    DASHLE_ASSERT(!m_Jits[depth]);
+
+    m_Envs[depth] = std::make_unique<ARMVM::Environment>(m_Mem, m_Bridge);
+    auto levelCfg = cfg;
+    levelCfg.callbacks = m_Envs[depth].get();
+    {
+        // Dynarmic allocates the code cache by itself, so look for the mapping that appeared meanwhile.
+        std::lock_guard lock(g_JitLock);
+        const auto oldMappings = hugeCodeCache ? host::memory::hostMappings(CODE_CACHE_PERMS) : decltype(m_CodeCache)();
+        m_Jits[depth] = std::make_unique<dynarmic32::Jit>(levelCfg);
+        if (hugeCodeCache)
+            adviseHugeCodeCache(oldMappings, levelCfg.code_cache_size);
+    }
+
+    m_Envs[depth]->m_CallContext.regs = &m_Jits[depth]->Regs();
+    m_Envs[depth]->m_CallContext.extRegs = &m_Jits[depth]->ExtRegs();
+    m_Envs[depth]->m_Jit = m_Jits[depth].get();
+    m_Envs[depth]->m_EndExecVAddr = m_EndExecVAddr;
+    m_Envs[depth]->m_BlockCounters = m_BlockCounters.get();
+    return m_Jits[depth].get();
+}
+
+ARMVM::ARMVM(std::shared_ptr<host::memory::MemoryManager> mem, std::shared_ptr<host::bridge::Bridge> bridge, GuestVersion version, const VMConfig& config)
+    : m_Mem(mem), m_Bridge(bridge), m_Scheduler(config.scheduler), m_Profiler(config.profiler) {
     DASHLE_ASSERT(m_Mem);
 
-    // Get special address used to know when to terminate execution.
+    // Get special addresses used to know when to terminate execution, one for each level of nested calls.
     DASHLE_ASSERT_WRAPPER_CONST(block, m_Mem->allocate({
-        .size = 4u, // Size of an ARM instruction
+        .size = MAX_CALL_DEPTH * 4u, // Size of an ARM instruction, for each level
         .alignment = 4u, // Aligned for a correct PC value
         .flags = 0u, // Must not be accessible
     }));
     m_EndExecVAddr = block->virtualBase;
 
-    // Create environment.
-    m_Env = std::make_unique<ARMVM::Environment>(mem, bridge);
+    // Allocate TLS slots, the first one points to itself. The memory may have been used by a previous thread.
+    DASHLE_ASSERT_WRAPPER_CONST(tlsBlock, m_Mem->allocate({
+        .size = TLS_SLOTS * sizeof(u32),
+        .alignment = sizeof(u32),
+    }));
+    m_TLSBase = tlsBlock->virtualBase;
+    DASHLE_ASSERT(m_Mem->fill(m_TLSBase, 0u, TLS_SLOTS * sizeof(u32)));
+    const auto self = static_cast<u32>(m_TLSBase);
+    DASHLE_ASSERT(m_Mem->write(m_TLSBase + TLS_SLOT_SELF * sizeof(u32), &self, sizeof(u32)));
+    m_CP15 = std::make_shared<CP15>(m_TLSBase);
+
+    if (config.blockCounters)
+        m_BlockCounters = config.blockCounters->createTable();
 
-    // Create exclusive monitor.
-    m_ExMon = std::make_unique<dynarmic::ExclusiveMonitor>(1);
+    // Use the shared exclusive monitor, or a private one.
+    m_ExMon = config.exclusiveMonitor;
+    if (!m_ExMon)
+        m_ExMon = std::make_shared<dynarmic::ExclusiveMonitor>(config.maxThreads);
 
     // Build config.
     dynarmic32::UserConfig cfg;
-    cfg.callbacks = m_Env.get();
 
     switch (version) {
         case GuestVersion::Armeabi:
@@ -214,9 +437,20 @@ ARMVM::ARMVM(std::shared_ptr<host::memory::MemoryManager> mem, std::shared_ptr<h
             DASHLE_UNREACHABLE("Invalid guest version!");
     }
 
+    DASHLE_ASSERT(config.processorId < config.maxThreads);
+    cfg.processor_id = config.processorId;
     cfg.global_monitor = m_ExMon.get();
-    cfg.enable_cycle_counting = false;
-    cfg.code_cache_size = 16u * 1024 * 1024;
+    cfg.coprocessors[15] = m_CP15;
+    cfg.enable_cycle_counting = m_Scheduler != nullptr;
+    cfg.code_cache_size = config.codeCacheSize;
+
+    // Let the Jit access memory inline if the whole address space is mapped linearly on the host.
+    // Faulting accesses fall back to the memory callbacks.
+    if (const auto fastmemBase = m_Mem->fastmemBase(); fastmemBase && m_Mem->maxMemory() >= ADDRESS_SPACE_SIZE) {
+        cfg.fastmem_pointer = fastmemBase.value();
+        // Exclusive stores become inline host CAS as well.
+        cfg.fastmem_exclusive_access = true;
+    }
 
     if constexpr(dashle::DEBUG_MODE) {
         cfg.optimizations = dynarmic::no_optimizations;
@@ -225,35 +459,207 @@ ARMVM::ARMVM(std::shared_ptr<host::memory::MemoryManager> mem, std::shared_ptr<h
     }
 
     // Create jit.
-    m_Jit = std::make_unique<dynarmic32::Jit>(cfg);
+    m_Jit = createLevel(0u, cfg, config.hugeCodeCache);
+
+    // Nested calls only run callbacks, they get smaller caches.
+    m_NestedConfig = cfg;
+    m_NestedConfig.code_cache_size = config.nestedCodeCacheSize;
+
+    if (m_Profiler)
+        m_Profiler->attach(this);
+}
+
+ARMVM::~ARMVM() {
+    if (m_Profiler)
+        m_Profiler->detach(this);
+
+    DASHLE_ASSERT(m_Mem->free(m_TLSBase));
+    DASHLE_ASSERT(m_Mem->free(m_EndExecVAddr));
 }
 
-ARMVM::~ARMVM() { DASHLE_ASSERT(m_Mem->free(m_EndExecVAddr)); }
+usize ARMVM::codeCacheHugePages() const {
+    usize count = 0u;
+    for (const auto& [base, size] : m_CodeCache)
+        count += host::memory::hostHugePages(base, size);
+
+    return count;
+}
 
 dynarmic::HaltReason ARMVM::execute(Optional<uaddr> wrappedAddr) {
     DASHLE_ASSERT(m_Jit);
+    // Host functions must go through callFunction().
+    DASHLE_ASSERT(!m_Depth);
+    makeCurrent();
+
+    // Host functions called meanwhile nest their calls on the next level.
+    Scheduler::Slot slot(m_Scheduler.get());
+    ++m_Depth;
+    struct Leave {
+        usize& depth;
+        ~Leave() { --depth; }
+    } leave { m_Depth };
 
     if (!wrappedAddr)
-        return m_Jit->Run();
+        return run(0u);
 
     DASHLE_ASSERT_WRAPPER_CONST(addr, wrappedAddr);
-    m_Jit->Regs()[regs::LR] = m_EndExecVAddr;
+    m_Jit->Regs()[regs::LR] = endExecVAddr(0u);
     setPC(addr);
 
+    // Once the call is done, other requests made meanwhile are moot.
+    const auto reason = run(0u);
+    return dynarmic::Has(reason, halt::RETURNED) ? VM_EXEC_SUCCESS : reason;
+}
+
+// Expired quantums and yields let other threads run, then execution resumes. Every other reason is up to the caller.
+dynarmic::HaltReason ARMVM::run(usize depth) {
+    auto& jit = *m_Jits[depth];
+    auto& env = *m_Envs[depth];
+    const auto outer = m_Running.exchange(&jit, std::memory_order_acq_rel);
+
+    if (m_Scheduler)
+        env.m_TicksRemaining = m_Scheduler->quantum();
+
     auto reason = VM_EXEC_SUCCESS;
-    while (reason == VM_EXEC_SUCCESS) {
-        reason = m_Jit->Run();
-        if (m_Jit->Regs()[regs::PC] == m_EndExecVAddr)
+    while (true) {
+        reason = jit.Run();
+
+        // Samples don't count as a turn.
+        if (dynarmic::Has(reason, halt::SAMPLE)) {
+            if (m_Profiler)
+                sample(depth);
+
+            reason = reason & ~halt::SAMPLE;
+            if (reason == VM_EXEC_SUCCESS && (!m_Scheduler || env.m_TicksRemaining))
+                continue;
+        }
+
+        if (reason != VM_EXEC_SUCCESS && reason != halt::YIELD)
             break;
 
-        DASHLE_LOG_LINE("PC: 0x{:X}, LR: 0x{:X}", m_Jit->Regs()[regs::PC], m_Jit->Regs()[regs::LR]);
+        if (m_Scheduler) {
+            m_Scheduler->yield();
+            env.m_TicksRemaining = m_Scheduler->quantum();
+        }
     }
 
+    m_Running.store(outer, std::memory_order_release);
     return reason;
 }
 
+// Follows the frame records ({FP, LR} pairs pushed by function prologues, as clang lays them out) of each level,
+// R11 being the frame pointer in ARM code and R7 in Thumb code. Without frame pointers, only the caller of leaf
+// functions is known, through LR. Outer levels are in a host function, called from their LR.
+void ARMVM::sample(usize depth) {
+    std::array<uaddr, Profiler::MAX_FRAMES> frames;
+    usize count = 0u;
+
+    const auto push = [&](u32 addr) {
+        // Calls from the host end on their end address.
+        if ((addr - m_EndExecVAddr) < MAX_CALL_DEPTH * 4u || count == frames.size())
+            return false;
+
+        frames[count++] = clearThumb(addr);
+        return true;
+    };
+
+    for (auto level = depth + 1u; level-- > 0u;) {
+        const auto& jit = *m_Jits[level];
+        const auto& r = jit.Regs();
+        const auto top = count;
+
+        if (level == depth) {
+            push(r[regs::PC]);
+        } else {
+            push(r[regs::LR]);
+        }
+
+        auto fp = static_cast<uaddr>(r[cpsrIsThumb(jit.Cpsr()) ? regs::R7 : regs::R11]);
+        while (fp && !(fp % sizeof(u32))) {
+            std::array<u32, 2u> record;
+            if (!m_Mem->read(fp, record.data(), sizeof(record)) || !push(record[1]))
+                break;
+
+            // The stack grows down, callers' records are above.
+            if (record[0] <= fp)
+                break;
+
+            fp = record[0];
+        }
+
+        if (level == depth && count == top + 1u)
+            push(r[regs::LR]);
+    }
+
+    m_Profiler->record(std::span(frames.data(), count));
+}
+
+Expected<u64> ARMVM::callFunction(uaddr addr, std::span<const u64> args) {
+    DASHLE_ASSERT(m_Jit);
+
+    if (args.size() > regs::R3 + 1u)
+        return Unexpected(Error::InvalidArgument);
+
+    const auto depth = m_Depth;
+    if (depth >= MAX_CALL_DEPTH)
+        return Unexpected(Error::InvalidOperation);
+
+    const auto caller = m_Jit;
+    const auto callee = m_Jits[depth] ? m_Jits[depth].get() : createLevel(depth, m_NestedConfig);
+
+    // The first level is shared with execute(), save its context on the stack.
+    struct Context {
+        std::array<u32, 16> regs;
+        std::array<u32, 64> extRegs;
+        u32 cpsr;
+        u32 fpscr;
+    } saved;
+
+    if (!depth)
+        saved = { callee->Regs(), callee->ExtRegs(), callee->Cpsr(), callee->Fpscr() };
+
+    // Run on the caller's stack, below its frame.
+    callee->Regs()[regs::SP] = caller->Regs()[regs::SP];
+    callee->SetCpsr(caller->Cpsr());
+    callee->SetFpscr(caller->Fpscr());
+    for (auto i = 0u; i < args.size(); ++i)
+        callee->Regs()[regs::R0 + i] = static_cast<u32>(args[i]);
+
+    callee->Regs()[regs::LR] = endExecVAddr(depth);
+    m_Jit = callee;
+    setPC(addr);
+    makeCurrent();
+
+    // Calls from the host take a slot, nested ones run on the caller's.
+    Scheduler::Slot slot(m_Scheduler.get());
+    ++m_Depth;
+    const auto reason = run(depth);
+    --m_Depth;
+
+    const auto result = callee->Regs()[regs::R0] | (static_cast<u64>(callee->Regs()[regs::R1]) << 32u);
+    if (!depth) {
+        callee->Regs() = saved.regs;
+        callee->ExtRegs() = saved.extRegs;
+        callee->SetCpsr(saved.cpsr);
+        callee->SetFpscr(saved.fpscr);
+    }
+
+    m_Jit = caller;
+    if (!dynarmic::Has(reason, halt::RETURNED)) {
+        // Stop the caller too once the host function returns, the callback was abandoned.
+        if (depth)
+            caller->HaltExecution(reason);
+
+        return Unexpected(Error::InvalidOperation);
+    }
+
+    return result;
+}
+
 dynarmic::HaltReason ARMVM::step(Optional<uaddr> wrappedAddr) {
     DASHLE_ASSERT(m_Jit);
+    DASHLE_ASSERT(!m_Depth);
+    makeCurrent();
 
     if (wrappedAddr) {
         DASHLE_ASSERT_WRAPPER_CONST(addr, wrappedAddr);
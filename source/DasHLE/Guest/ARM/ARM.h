@@ -5,6 +5,8 @@
 #include "DasHLE/Host/Bridge.h"
 #include "DasHLE/Guest/VM.h"
 
+#include <atomic>
+
 namespace dashle::guest::arm {
 
 namespace regs {
@@ -36,40 +38,89 @@ constexpr static usize FPSCR = R15 + 2;
 
 class ARMVM final : public VM {
     class Environment;
+    class CP15;
 
     std::shared_ptr<host::memory::MemoryManager> m_Mem;
-    std::unique_ptr<Environment> m_Env;
-    std::unique_ptr<dynarmic::ExclusiveMonitor> m_ExMon;
-    std::unique_ptr<dynarmic32::Jit> m_Jit;
-    uaddr m_EndExecVAddr = 0u;
+    std::shared_ptr<host::bridge::Bridge> m_Bridge;
+    std::shared_ptr<CP15> m_CP15;
+    std::shared_ptr<dynarmic::ExclusiveMonitor> m_ExMon;
+    std::shared_ptr<Scheduler> m_Scheduler;
+    std::shared_ptr<Profiler> m_Profiler;
+    std::shared_ptr<BlockCounters::Table> m_BlockCounters;
+    // A Jit can't be reentered, so each level of nested calls runs on its own one, created on first use.
+    std::array<std::unique_ptr<Environment>, MAX_CALL_DEPTH> m_Envs;
+    std::array<std::unique_ptr<dynarmic32::Jit>, MAX_CALL_DEPTH> m_Jits;
+    dynarmic32::UserConfig m_NestedConfig;
+    dynarmic32::Jit* m_Jit = nullptr; // Innermost running Jit, whose context is exposed.
+    usize m_Depth = 0u;
+    std::atomic<dynarmic32::Jit*> m_Running = nullptr; // Innermost Jit inside Run(), for other threads.
+    uaddr m_EndExecVAddr = 0u; // One per level.
+    uaddr m_TLSBase = 0u;
+    std::vector<std::pair<uaddr, usize>> m_CodeCache; // Host mappings, only known if huge pages were requested.
 
     void setPC(uaddr addr);
+    void adviseHugeCodeCache(const std::vector<std::pair<uaddr, usize>>& oldMappings, usize codeCacheSize);
+    dynarmic32::Jit* createLevel(usize depth, const dynarmic32::UserConfig& cfg, bool hugeCodeCache = false);
+    dynarmic::HaltReason run(usize depth);
+    void sample(usize depth);
+    uaddr endExecVAddr(usize depth) const { return m_EndExecVAddr + depth * sizeof(u32); }
 
 public:
-    ARMVM(std::shared_ptr<host::memory::MemoryManager> mem, std::shared_ptr<host::bridge::Bridge> bridge, GuestVersion version);
+    ARMVM(std::shared_ptr<host::memory::MemoryManager> mem, std::shared_ptr<host::bridge::Bridge> bridge, GuestVersion version, const VMConfig& config = {});
     ARMVM(const ARMVM&) = delete;
-    ARMVM(ARMVM&&) = default;
+    ARMVM(ARMVM&&) = delete; // The profiler knows it by address.
     ~ARMVM();
 
     ARMVM& operator=(const ARMVM&) = delete;
-    ARMVM& operator=(ARMVM&&) = default;
+    ARMVM& operator=(ARMVM&&) = delete;
 
     dynarmic::HaltReason execute(Optional<uaddr> addr = {}) override;
     dynarmic::HaltReason step(Optional<uaddr> addr = {}) override;
 
-    void clearCache() override {
+    void halt(dynarmic::HaltReason reason) override {
         DASHLE_ASSERT(m_Jit);
-        m_Jit->ClearCache();
+        m_Jit->HaltExecution(reason);
+    }
+
+    // The Jit may leave Run() meanwhile, it then returns right away next time, which run() copes with.
+    void interrupt(dynarmic::HaltReason reason) override {
+        if (const auto jit = m_Running.load(std::memory_order_acquire))
+            jit->HaltExecution(reason);
+    }
+
+    void clearCache() override {
+        for (auto& jit : m_Jits) {
+            if (jit)
+                jit->ClearCache();
+        }
     }
 
     void invalidateCache(uaddr addr, usize size) override {
-        DASHLE_ASSERT(m_Jit);
-        m_Jit->InvalidateCacheRange(addr, size);
+        for (auto& jit : m_Jits) {
+            if (jit)
+                jit->InvalidateCacheRange(addr, size);
+        }
     }
 
+    usize numRegisters() const override { return regs::FPSCR + 1u; }
     void setRegister(usize id, u64 value) override;
     u64 getRegister(usize id) const override;
 
+    void setStackPointer(uaddr sp) override { setRegister(regs::SP, sp); }
+
+    void setArgument(usize index, u64 value) override {
+        DASHLE_ASSERT(index <= regs::R3);
+        setRegister(regs::R0 + index, value);
+    }
+
+    u64 returnValue() const override { return getRegister(regs::R0); }
+
+    Expected<u64> callFunction(uaddr addr, std::span<const u64> args) override;
+
+    uaddr tlsBase() const override { return m_TLSBase; }
+
+    usize codeCacheHugePages() const override;
+
     void dumpContext() const override;
 };
 
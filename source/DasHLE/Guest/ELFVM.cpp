@@ -35,18 +35,30 @@ static bool canRun(elf::ELF& elf) {
 
 template <typename T>
 requires (OneOf<T, elf::Addr32, elf::Addr64>)
-static void arrayRead(std::vector<usize>& entries, uaddr addr, usize numEntries) {
+static Expected<void> arrayRead(const host::memory::MemoryManager& mem, std::vector<usize>& entries, uaddr vaddr, usize numEntries) {
+    std::vector<T> array(numEntries);
+    DASHLE_TRY_EXPECTED_VOID(mem.read(vaddr, array.data(), numEntries * sizeof(T)));
+
     entries.clear();
-    const auto array = reinterpret_cast<const T*>(addr);
-    for (auto i = 0u; i < numEntries; ++i) {
-        const auto addr = array[i];
-        if (addr != 0 && addr != -1)
+    for (const auto addr : array) {
+        if (addr != 0 && addr != static_cast<T>(-1))
             entries.push_back(addr);
     }
+
+    return EXPECTED_VOID;
 }
 
-ELFVM::ELFVM(std::shared_ptr<host::memory::MemoryManager> mem, usize pageSize, usize stackSize)
-    : m_Mem(mem), m_PageSize(pageSize) {
+// Every VM running the binary must share the same exclusive monitor.
+static VMConfig withExclusiveMonitor(const VMConfig& config) {
+    auto ret = config;
+    if (!ret.exclusiveMonitor)
+        ret.exclusiveMonitor = std::make_shared<dynarmic::ExclusiveMonitor>(ret.maxThreads);
+
+    return ret;
+}
+
+ELFVM::ELFVM(std::shared_ptr<host::memory::MemoryManager> mem, usize pageSize, usize stackSize, const VMConfig& config)
+    : m_Mem(mem), m_PageSize(pageSize), m_Config(withExclusiveMonitor(config)) {
     DASHLE_ASSERT(m_Mem);
     // Alignment must be a power of two.
     DASHLE_ASSERT(dashle::isPowerOfTwo(m_PageSize));
@@ -60,18 +72,26 @@ ELFVM::ELFVM(std::shared_ptr<host::memory::MemoryManager> mem, usize pageSize, u
         .flags = host::memory::flags::FORCE_HINT,
     }));
 
-    // Allocate stack.
+    // Allocate stack, only the pages it grows into get committed.
     DASHLE_ASSERT_WRAPPER_CONST(block, m_Mem->allocate({
         .size = stackSize,
         .alignment = m_PageSize,
         .hint = m_Mem->maxMemory() - stackSize,
-        .flags = host::memory::flags::PERM_READ_WRITE | host::memory::flags::FORCE_HINT
+        .flags = host::memory::flags::PERM_READ_WRITE | host::memory::flags::FORCE_HINT | host::memory::flags::LAZY_COMMIT
     }));
     m_StackBase = block->virtualBase;
     m_StackTop = m_StackBase + block->size;
+
+    // Threads get stacks as big as the main one.
+    m_Threads = std::make_shared<ThreadManager>(m_Mem, [this](usize processorId) {
+        return createVM(processorId);
+    }, m_Config.maxThreads, stackSize, m_PageSize);
 }
 
 ELFVM::~ELFVM() {
+    // Threads may still be using the binary.
+    m_Threads->waitAll();
+
     // Free loaded segments.
     for (auto vaddr : m_LoadedSegments) {
         DASHLE_ASSERT(m_Mem->free(vaddr));
@@ -87,7 +107,7 @@ ELFVM::~ELFVM() {
 Expected<void> ELFVM::loadBinary(std::vector<u8>&& buffer) {
     const auto virtualToHost = [this](uaddr vaddr) -> Expected<uaddr> {
         DASHLE_TRY_EXPECTED_CONST(block, m_Mem->blockFromVAddr(vaddr));
-        return host::memory::virtualToHost(*block, vaddr);
+        return host::memory::virtualToHost(block, vaddr);
     };
 
     const auto relocWriteVAddr = [this](uaddr addr, uaddr vaddr) {
@@ -139,25 +159,27 @@ Expected<void> ELFVM::loadBinary(std::vector<u8>&& buffer) {
 
     // Get binary base.
     DASHLE_TRY_EXPECTED_CONST(binaryBase, m_Mem->findFreeAddr(binaryAllocSize, m_PageSize));
+    m_BinaryBase = binaryBase;
 
-    // Allocate and map each segment.
+    // Allocate and map each segment, zero filled parts (.bss) are committed when touched.
     m_LoadedSegments.clear();
     for (const auto& segmentInfo : loadSegmentsInfo) {
         DASHLE_TRY_EXPECTED_CONST(block, m_Mem->allocate({
             .size = segmentInfo.allocSize,
             .alignment = m_PageSize,
             .hint = binaryBase + segmentInfo.allocOffset,
-            .flags = host::memory::flags::PERM_READ_WRITE | host::memory::flags::FORCE_HINT,
+            .flags = host::memory::flags::PERM_READ_WRITE | host::memory::flags::FORCE_HINT | host::memory::flags::LAZY_COMMIT,
         }));
 
-        std::copy(m_Elf.buffer().data() + segmentInfo.fileDataOffset,
-            m_Elf.buffer().data() + segmentInfo.fileDataOffset + segmentInfo.fileDataSize,
-            reinterpret_cast<u8*>(block->hostBase) + segmentInfo.memDataOffset);
+        DASHLE_TRY_EXPECTED_VOID(m_Mem->write(block->virtualBase + segmentInfo.memDataOffset,
+            m_Elf.buffer().data() + segmentInfo.fileDataOffset, segmentInfo.fileDataSize));
 
         m_LoadedSegments.push_back(block->virtualBase);
     }
 
     // Handle relocations.
+    // Most symbols are referenced by several relocations, resolve each of them once.
+    std::vector<Optional<uaddr>> resolvedSymbols;
     for (const auto& reloc : m_Elf.relocs()) {
         DASHLE_TRY_EXPECTED_CONST(patchAddr, virtualToHost(binaryBase + reloc.patchOffset));
 
@@ -172,30 +194,35 @@ Expected<void> ELFVM::loadBinary(std::vector<u8>&& buffer) {
         }
 
         if (reloc.kind == elf::RelocKind::Symbol) {
-            DASHLE_ASSERT_WRAPPER_CONST(symbol, reloc.symbol);
-
-            uaddr vaddr = 0u;
-            if constexpr (dashle::DEBUG_MODE) {
-                static uaddr fakeAddr = 0u;
-                static std::unordered_map<std::string, uaddr> cache;
-                vaddr = m_Bridge->addressForSymbol(symbol).or_else([&](dashle::Error) -> Expected<uaddr> {
-                    if (cache.contains(symbol)) {
-                        return cache[symbol];
-                    }
-
-                    auto fake = fakeAddr;
-                    fakeAddr += 4u;
-                    cache[symbol] = fake;
-                    DASHLE_LOG_LINE("MISSING IMPORT: \"{}\" (0x{:X})", symbol, fake);
-                    return fake;
-                }).value();
-            } else {
-                DASHLE_TRY_EXPECTED_CONST(vaddr2, m_Bridge->addressForSymbol(symbol));
-                vaddr = vaddr2;
+            if (reloc.symbolIndex >= resolvedSymbols.size())
+                resolvedSymbols.resize(reloc.symbolIndex + 1u);
+
+            auto& resolved = resolvedSymbols[reloc.symbolIndex];
+            if (!resolved) {
+                DASHLE_ASSERT_WRAPPER_CONST(symbol, reloc.symbol);
+
+                if constexpr (dashle::DEBUG_MODE) {
+                    static uaddr fakeAddr = 0u;
+                    static std::unordered_map<std::string, uaddr> cache;
+                    resolved = m_Bridge->addressForSymbol(symbol).or_else([&](dashle::Error) -> Expected<uaddr> {
+                        if (cache.contains(symbol)) {
+                            return cache[symbol];
+                        }
+
+                        auto fake = fakeAddr;
+                        fakeAddr += 4u;
+                        cache[symbol] = fake;
+                        DASHLE_LOG_LINE("MISSING IMPORT: \"{}\" (0x{:X})", symbol, fake);
+                        return fake;
+                    }).value();
+                } else {
+                    DASHLE_TRY_EXPECTED_CONST(vaddr, m_Bridge->addressForSymbol(symbol));
+                    resolved = vaddr;
+                }
             }
 
             // We ignore the addend.
-            relocWriteVAddr(patchAddr, vaddr);
+            relocWriteVAddr(patchAddr, resolved.value());
             continue;
         }
 
@@ -211,40 +238,47 @@ Expected<void> ELFVM::loadBinary(std::vector<u8>&& buffer) {
     const auto initWrapper = m_Elf.initArrayInfo();
     if (initWrapper) {
         const auto& initArrayInfo = initWrapper.value();
-        DASHLE_TRY_EXPECTED_CONST(initArray, virtualToHost(binaryBase + initArrayInfo.offset));
-        m_Initializers.clear();
+        const auto initArray = binaryBase + initArrayInfo.offset;
         if (m_Elf.is64Bits()) {
-            arrayRead<elf::Addr64>(m_Initializers, initArray, initArrayInfo.size);
+            DASHLE_TRY_EXPECTED_VOID(arrayRead<elf::Addr64>(*m_Mem, m_Initializers, initArray, initArrayInfo.size));
         } else {
-            arrayRead<elf::Addr32>(m_Initializers, initArray, initArrayInfo.size);
+            DASHLE_TRY_EXPECTED_VOID(arrayRead<elf::Addr32>(*m_Mem, m_Initializers, initArray, initArrayInfo.size));
         }
     }
 
     const auto finiWrapper = m_Elf.finiArrayInfo();
     if (finiWrapper) {
         const auto& finiArrayInfo = finiWrapper.value();
-        DASHLE_TRY_EXPECTED_CONST(finiArray, virtualToHost(binaryBase + finiArrayInfo.offset));
-        m_Finalizers.clear();
+        const auto finiArray = binaryBase + finiArrayInfo.offset;
         if (m_Elf.is64Bits()) {
-            arrayRead<elf::Addr64>(m_Finalizers, finiArray, finiArrayInfo.size);
+            DASHLE_TRY_EXPECTED_VOID(arrayRead<elf::Addr64>(*m_Mem, m_Finalizers, finiArray, finiArrayInfo.size));
         } else {
-            arrayRead<elf::Addr32>(m_Finalizers, finiArray, finiArrayInfo.size);
+            DASHLE_TRY_EXPECTED_VOID(arrayRead<elf::Addr32>(*m_Mem, m_Finalizers, finiArray, finiArrayInfo.size));
         }
     }
 
-    // Instantiate VM.
+    // Instantiate VM for the main thread.
+    m_VM = createVM(0u);
+    m_VM->setStackPointer(m_StackTop);
+
+    return EXPECTED_VOID;
+}
+
+std::unique_ptr<VM> ELFVM::createVM(usize processorId) const {
+    DASHLE_ASSERT(m_Bridge);
+
+    auto config = m_Config;
+    config.processorId = processorId;
+
     if (m_Elf.is64Bits()) {
         DASHLE_UNREACHABLE("Guest not supported!");
     } else {
 #if defined(DASHLE_HAS_GUEST_ARM)
-        m_VM = std::make_unique<arm::ARMVM>(m_Mem, m_Bridge, m_Elf.version());
-        m_VM->setRegister(arm::regs::SP, m_StackTop);
+        return std::make_unique<arm::ARMVM>(m_Mem, m_Bridge, m_Elf.version(), config);
 #else
         DASHLE_UNREACHABLE("Guest not supported!");
 #endif // DASHLE_HAS_GUEST_ARM
     }
-
-    return EXPECTED_VOID;
 }
 
 Expected<void> ELFVM::loadBinary(const host::fs::path& path) {
@@ -280,5 +314,43 @@ Expected<void> ELFVM::runFinalizers() {
         }
     }
 
+    return EXPECTED_VOID;
+}
+
+Expected<Symbolizer> ELFVM::symbolizer() const {
+    if (m_LoadedSegments.empty())
+        return Unexpected(Error::InvalidOperation);
+
+    Symbolizer symbols;
+    DASHLE_TRY_EXPECTED_VOID(symbols.addImage(m_Elf, m_BinaryBase));
+    return symbols;
+}
+
+Expected<ELFVM::Snapshot> ELFVM::snapshot() const {
+    if (!m_VM)
+        return Unexpected(Error::InvalidOperation);
+
+    DASHLE_TRY_EXPECTED(memory, m_Mem->snapshot());
+
+    Snapshot snapshot;
+    snapshot.memory = std::move(memory);
+    snapshot.registers.resize(m_VM->numRegisters());
+    for (auto i = 0u; i < snapshot.registers.size(); ++i)
+        snapshot.registers[i] = m_VM->getRegister(i);
+
+    return snapshot;
+}
+
+Expected<void> ELFVM::restore(const Snapshot& snapshot) {
+    if (!m_VM || !snapshot.memory || snapshot.registers.size() != m_VM->numRegisters())
+        return Unexpected(Error::InvalidOperation);
+
+    DASHLE_TRY_EXPECTED_VOID(m_Mem->restore(*snapshot.memory));
+
+    for (auto i = 0u; i < snapshot.registers.size(); ++i)
+        m_VM->setRegister(i, snapshot.registers[i]);
+
+    // Code may have changed since it was translated.
+    m_VM->clearCache();
     return EXPECTED_VOID;
 }
\ No newline at end of file
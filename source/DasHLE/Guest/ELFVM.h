@@ -6,6 +6,7 @@
 #include "DasHLE/Host/Memory.h"
 #include "DasHLE/Host/Bridge.h"
 #include "DasHLE/Guest/VM.h"
+#include "DasHLE/Guest/Threads.h"
 #include "DasHLE/Guest/ARM/ARM.h"
 
 #include <type_traits>
@@ -13,31 +14,62 @@
 namespace dashle::guest {
 
 class ELFVM {
+public:
+    // Guest state at some point in time.
+    // Host side state of HLE modules (e.g. the guest heap) is not part of it, and must be captured separately.
+    struct Snapshot {
+        std::shared_ptr<const host::memory::MemorySnapshot> memory;
+        std::vector<u64> registers;
+    };
+
 protected:
     std::shared_ptr<host::memory::MemoryManager> m_Mem;
     std::shared_ptr<host::bridge::Bridge> m_Bridge;
     std::unique_ptr<VM> m_VM;
+    std::shared_ptr<ThreadManager> m_Threads;
     const usize m_PageSize = 0u;
+    const VMConfig m_Config;
     uaddr m_StackBase = 0u;
     uaddr m_StackTop = 0u;
     binary::elf::ELF m_Elf;
+    uaddr m_BinaryBase = 0u;
     std::vector<uaddr> m_LoadedSegments;
     std::vector<uaddr> m_Initializers;
     std::vector<uaddr> m_Finalizers;
 
     virtual Expected<void> populateBridge() = 0;
 
+    // Create a VM for the loaded binary, see VMConfig::processorId.
+    std::unique_ptr<VM> createVM(usize processorId) const;
+
 public:
-    ELFVM(std::shared_ptr<host::memory::MemoryManager> mem, usize pageSize, usize stackSize);
+    ELFVM(std::shared_ptr<host::memory::MemoryManager> mem, usize pageSize, usize stackSize, const VMConfig& config = {});
     virtual ~ELFVM();
 
     const binary::elf::ELF& elf() const { return m_Elf; }
 
+    // Address the binary was loaded at, ELF addresses are relative to it.
+    uaddr binaryBase() const { return m_BinaryBase; }
+
+    // Functions of the loaded binary, to make sense of profiles and block counters.
+    Expected<Symbolizer> symbolizer() const;
+    VM* vm() const { return m_VM.get(); }
+
+    // Guest threads other than the main one, which runs on vm().
+    const std::shared_ptr<ThreadManager>& threads() const { return m_Threads; }
+
     Expected<void> loadBinary(std::vector<u8>&& buffer);
     Expected<void> loadBinary(const host::fs::path& path);
 
     Expected<void> runInitializers();
     Expected<void> runFinalizers();
+
+    // Capture guest memory and registers, typically after the initializers have run.
+    Expected<Snapshot> snapshot() const;
+
+    // Go back to a snapshot taken from this VM, or from one which loaded the same binary in the same way.
+    // Restored memory shares pages with the snapshot until written, so this is cheap to do repeatedly.
+    Expected<void> restore(const Snapshot& snapshot);
 };
 
 } // namespace dashle::guest
@@ -0,0 +1,215 @@
+#include "DasHLE/Guest/VM.h"
+#include "DasHLE/Guest/Profiler.h"
+
+#include <algorithm>
+
+using namespace dashle;
+using namespace dashle::guest;
+
+// Symbolizer
+
+void Symbolizer::add(std::string name, uaddr start, usize size) {
+    const auto it = std::upper_bound(m_Ranges.begin(), m_Ranges.end(), start, [](uaddr addr, const Range& range) {
+        return addr < range.start;
+    });
+
+    m_Ranges.insert(it, Range { .start = start, .size = size, .name = std::move(name) });
+}
+
+Expected<void> Symbolizer::addImage(const binary::elf::ELF& elf, uaddr base) {
+    DASHLE_TRY_EXPECTED(symbols, elf.functionSymbols());
+
+    for (auto& symbol : symbols) {
+        // The Thumb bit is not part of the address.
+        m_Ranges.push_back(Range {
+            .start = base + (symbol.value & ~static_cast<uaddr>(1u)),
+            .size = symbol.size,
+            .name = std::move(symbol.name),
+        });
+    }
+
+    // Exported functions are in both tables.
+    std::stable_sort(m_Ranges.begin(), m_Ranges.end(), [](const Range& a, const Range& b) {
+        return a.start < b.start;
+    });
+
+    const auto last = std::unique(m_Ranges.begin(), m_Ranges.end(), [](const Range& a, const Range& b) {
+        return a.start == b.start && a.name == b.name;
+    });
+
+    m_Ranges.erase(last, m_Ranges.end());
+    return EXPECTED_VOID;
+}
+
+Optional<Symbolizer::Symbol> Symbolizer::lookup(uaddr addr) const {
+    auto it = std::upper_bound(m_Ranges.begin(), m_Ranges.end(), addr, [](uaddr addr, const Range& range) {
+        return addr < range.start;
+    });
+
+    if (it == m_Ranges.begin())
+        return {};
+
+    --it;
+    if (it->size && (addr - it->start) >= it->size)
+        return {};
+
+    return Symbol { .name = it->name, .start = it->start, .size = it->size };
+}
+
+Optional<std::string_view> Symbolizer::symbolize(uaddr addr) const {
+    return lookup(addr).transform([](const Symbol& symbol) { return symbol.name; });
+}
+
+std::string Symbolizer::describe(uaddr addr) const {
+    if (const auto name = symbolize(addr))
+        return std::string(name.value());
+
+    return DASHLE_FORMAT("0x{:X}", addr);
+}
+
+// Profiler
+
+void Profiler::tick(std::stop_token token) {
+    while (!token.stop_requested()) {
+        std::this_thread::sleep_for(m_Interval);
+
+        std::lock_guard lock(m_Lock);
+        for (auto vm : m_VMs)
+            vm->interrupt(halt::SAMPLE);
+    }
+}
+
+Profiler::Profiler(std::chrono::microseconds interval) : m_Interval(interval) {
+    DASHLE_ASSERT(m_Interval.count() > 0);
+}
+
+Profiler::~Profiler() {
+    stop();
+    DASHLE_ASSERT(m_VMs.empty());
+}
+
+void Profiler::start() {
+    if (!m_Timer.joinable())
+        m_Timer = std::jthread([this](std::stop_token token) { tick(token); });
+}
+
+void Profiler::stop() {
+    if (m_Timer.joinable()) {
+        m_Timer.request_stop();
+        m_Timer.join();
+    }
+}
+
+void Profiler::attach(VM* vm) {
+    DASHLE_ASSERT(vm);
+    std::lock_guard lock(m_Lock);
+    m_VMs.push_back(vm);
+}
+
+void Profiler::detach(VM* vm) {
+    std::lock_guard lock(m_Lock);
+    const auto it = std::find(m_VMs.begin(), m_VMs.end(), vm);
+    DASHLE_ASSERT(it != m_VMs.end());
+    m_VMs.erase(it);
+}
+
+void Profiler::record(std::span<const uaddr> frames) {
+    if (frames.empty())
+        return;
+
+    std::lock_guard lock(m_Lock);
+    ++m_Stacks[std::vector<uaddr>(frames.begin(), frames.end())];
+    ++m_Samples;
+}
+
+u64 Profiler::samples() {
+    std::lock_guard lock(m_Lock);
+    return m_Samples;
+}
+
+void Profiler::reset() {
+    std::lock_guard lock(m_Lock);
+    m_Stacks.clear();
+    m_Samples = 0u;
+}
+
+std::string Profiler::folded(const Symbolizer& symbols) {
+    // Stacks going through the same functions are merged.
+    std::map<std::string, u64> lines;
+    {
+        std::lock_guard lock(m_Lock);
+        for (const auto& [frames, count] : m_Stacks) {
+            std::string line;
+            for (auto i = frames.size(); i-- > 0u;) {
+                // Return addresses may be past the end of the caller, if the call was its last instruction.
+                const auto name = symbols.symbolize(i ? frames[i] - 1u : frames[i]);
+                line += name ? std::string(name.value()) : DASHLE_FORMAT("0x{:X}", frames[i]);
+                if (i)
+                    line += ';';
+            }
+
+            lines[line] += count;
+        }
+    }
+
+    std::string output;
+    for (const auto& [line, count] : lines)
+        output += DASHLE_FORMAT("{} {}\n", line, count);
+
+    return output;
+}
+
+// BlockCounters
+
+std::shared_ptr<BlockCounters::Table> BlockCounters::createTable() {
+    std::lock_guard lock(m_Lock);
+    return m_Tables.emplace_back(std::make_shared<Table>());
+}
+
+std::vector<BlockCounters::Block> BlockCounters::blocks() {
+    std::unordered_map<uaddr, u64> merged;
+    {
+        std::lock_guard lock(m_Lock);
+        for (const auto& table : m_Tables) {
+            for (const auto& [addr, count] : table->m_Counts)
+                merged[addr] += count;
+        }
+    }
+
+    std::vector<Block> blocks;
+    blocks.reserve(merged.size());
+    for (const auto& [addr, count] : merged) {
+        if (count)
+            blocks.push_back(Block { .addr = addr, .count = count });
+    }
+
+    std::sort(blocks.begin(), blocks.end(), [](const Block& a, const Block& b) {
+        return a.count != b.count ? a.count > b.count : a.addr < b.addr;
+    });
+
+    return blocks;
+}
+
+void BlockCounters::reset() {
+    std::lock_guard lock(m_Lock);
+    for (const auto& table : m_Tables) {
+        for (auto& [addr, count] : table->m_Counts)
+            count = 0u;
+    }
+}
+
+std::string BlockCounters::report(const Symbolizer& symbols, usize maxBlocks) {
+    const auto hot = blocks();
+
+    std::string output;
+    for (auto i = 0u; i < std::min(maxBlocks, hot.size()); ++i) {
+        const auto& block = hot[i];
+        // The Thumb bit is not part of the address.
+        const auto addr = block.addr & ~static_cast<uaddr>(1u);
+        const auto symbol = symbols.lookup(addr);
+        const auto location = symbol ? DASHLE_FORMAT("{}+0x{:X}", symbol->name, addr - symbol->start) : std::string("?");
+        output += DASHLE_FORMAT("0x{:X} {} {}\n", block.addr, location, block.count);
+    }
+
+    return output;
+}
@@ -0,0 +1,125 @@
+#ifndef _DASHLE_GUEST_PROFILER_H
+#define _DASHLE_GUEST_PROFILER_H
+
+#include "DasHLE/Binary/ELF.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace dashle::guest {
+
+class VM;
+
+// Maps guest addresses to the functions containing them.
+class Symbolizer final {
+    struct Range {
+        uaddr start;
+        usize size; // Zero if unknown, the function then ends where the next one starts.
+        std::string name;
+    };
+
+    std::vector<Range> m_Ranges; // Sorted by start address.
+
+public:
+    struct Symbol {
+        std::string_view name;
+        uaddr start;
+        usize size;
+    };
+
+    void add(std::string name, uaddr start, usize size);
+
+    // Add the functions of a binary loaded at base.
+    Expected<void> addImage(const binary::elf::ELF& elf, uaddr base);
+
+    Optional<Symbol> lookup(uaddr addr) const;
+    Optional<std::string_view> symbolize(uaddr addr) const;
+
+    // Function name, or the address itself if unknown.
+    std::string describe(uaddr addr) const;
+};
+
+// Samples the guest stacks of the attached VMs at a fixed interval.
+// The timer thread only interrupts the VMs, which then record their own stack before resuming.
+class Profiler final {
+    std::mutex m_Lock;
+    std::vector<VM*> m_VMs;
+    std::map<std::vector<uaddr>, u64> m_Stacks; // Leaf first.
+    u64 m_Samples = 0u;
+    const std::chrono::microseconds m_Interval;
+    std::jthread m_Timer;
+
+    void tick(std::stop_token token);
+
+public:
+    constexpr static usize MAX_FRAMES = 64u;
+
+    Profiler(std::chrono::microseconds interval);
+    Profiler(const Profiler&) = delete;
+    ~Profiler();
+
+    Profiler& operator=(const Profiler&) = delete;
+
+    void start();
+    void stop();
+
+    // VMs attach themselves for their lifetime, see VMConfig::profiler.
+    void attach(VM* vm);
+    void detach(VM* vm);
+
+    // Called by VMs with their stack, leaf first. Every frame but the leaf is a return address.
+    void record(std::span<const uaddr> frames);
+
+    u64 samples();
+    void reset();
+
+    // Samples in the folded stack format ("root;...;leaf count" lines), as read by flamegraph.pl.
+    std::string folded(const Symbolizer& symbols);
+};
+
+// Counts how many times each block of guest code runs, blocks being keyed by their start address
+// (with the low bit set for Thumb code). VMs count into tables of their own, merged on demand.
+class BlockCounters final {
+public:
+    // Counters of a single VM, only touched by the thread running it.
+    class Table final {
+        std::unordered_map<uaddr, u64> m_Counts;
+
+        friend class BlockCounters;
+
+    public:
+        // Its address stays valid for the lifetime of the table.
+        u64* counter(uaddr addr) { return &m_Counts[addr]; }
+    };
+
+    struct Block {
+        uaddr addr;
+        u64 count;
+    };
+
+private:
+    std::mutex m_Lock;
+    std::vector<std::shared_ptr<Table>> m_Tables; // Kept once VMs are gone.
+
+public:
+    std::shared_ptr<Table> createTable();
+
+    // Must not be called while VMs run, sorted by decreasing count.
+    std::vector<Block> blocks();
+    void reset();
+
+    // Hottest blocks, one "addr symbol+offset count" line each.
+    std::string report(const Symbolizer& symbols, usize maxBlocks);
+};
+
+} // namespace dashle::guest
+
+#endif /* _DASHLE_GUEST_PROFILER_H */
@@ -0,0 +1,101 @@
+#include "DasHLE/Host/Sync.h"
+#include "DasHLE/Guest/Scheduler.h"
+
+using namespace dashle;
+using namespace dashle::guest;
+
+// Scheduler
+
+void Scheduler::acquire() {
+    DASHLE_ASSERT(!s_Held);
+
+    std::unique_lock lock(m_Lock);
+    const auto ticket = m_NextTicket++;
+    m_Released.wait(lock, [this, ticket] {
+        return ticket == m_ServedTicket && m_Running < m_Slots;
+    });
+
+    ++m_ServedTicket;
+    ++m_Running;
+    s_Held = this;
+
+    // The next thread in line may be able to run as well.
+    if (m_ServedTicket != m_NextTicket && m_Running < m_Slots)
+        m_Released.notify_all();
+}
+
+void Scheduler::release() {
+    DASHLE_ASSERT(s_Held == this);
+
+    {
+        std::lock_guard lock(m_Lock);
+        --m_Running;
+        s_Held = nullptr;
+    }
+
+    m_Released.notify_all();
+}
+
+Scheduler::Scheduler(usize slots, u64 quantum)
+    : m_Slots(slots), m_Quantum(quantum) {
+    DASHLE_ASSERT(m_Slots);
+    DASHLE_ASSERT(m_Quantum);
+    host::sync::setWaitHook(&Scheduler::waitHook);
+}
+
+usize Scheduler::running() {
+    std::lock_guard lock(m_Lock);
+    return m_Running;
+}
+
+void Scheduler::yield() {
+    {
+        std::lock_guard lock(m_Lock);
+        if (m_ServedTicket == m_NextTicket)
+            return;
+    }
+
+    release();
+    acquire();
+}
+
+void Scheduler::waitHook(bool blocked) {
+    // Nothing to give away in host threads, or to take back if nothing was given.
+    static thread_local Scheduler* s_Blocked = nullptr;
+
+    if (blocked && s_Held) {
+        s_Blocked = s_Held;
+        s_Blocked->release();
+    } else if (!blocked && s_Blocked) {
+        s_Blocked->acquire();
+        s_Blocked = nullptr;
+    }
+}
+
+// Slot
+
+Scheduler::Slot::Slot(Scheduler* scheduler) {
+    if (scheduler && !s_Held) {
+        m_Scheduler = scheduler;
+        m_Scheduler->acquire();
+    }
+}
+
+Scheduler::Slot::~Slot() {
+    if (m_Scheduler)
+        m_Scheduler->release();
+}
+
+// Blocking
+
+Scheduler::Blocking::Blocking() {
+    if (s_Held) {
+        m_Scheduler = s_Held;
+        m_Scheduler->release();
+    }
+}
+
+Scheduler::Blocking::~Blocking() {
+    if (m_Scheduler)
+        m_Scheduler->acquire();
+}
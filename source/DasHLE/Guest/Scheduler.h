@@ -0,0 +1,74 @@
+#ifndef _DASHLE_GUEST_SCHEDULER_H
+#define _DASHLE_GUEST_SCHEDULER_H
+
+#include "DasHLE/Support/Types.h"
+
+#include <condition_variable>
+#include <mutex>
+
+namespace dashle::guest {
+
+// Limits how many guest threads run guest code at once, so many of them can share a fixed number of host cores.
+// Threads hold a slot while running, and give it to the next waiting thread (in FIFO order) when their tick
+// quantum expires, when they yield, and while they are blocked in host functions.
+class Scheduler final {
+    static inline thread_local Scheduler* s_Held = nullptr;
+
+    std::mutex m_Lock;
+    std::condition_variable m_Released;
+    const usize m_Slots;
+    const u64 m_Quantum;
+    usize m_Running = 0u;
+    u64 m_NextTicket = 0u;    // Given to the next waiting thread.
+    u64 m_ServedTicket = 0u; // Next waiting thread allowed to run.
+
+    void acquire();
+    void release();
+
+public:
+    Scheduler(usize slots, u64 quantum);
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    usize slots() const { return m_Slots; }
+
+    // Ticks a thread may run before letting others run.
+    u64 quantum() const { return m_Quantum; }
+
+    // Number of threads holding a slot.
+    usize running();
+
+    // Let waiting threads run first, if any, must hold a slot.
+    void yield();
+
+    // Holds a slot for its lifetime, unless the thread already holds one.
+    class Slot final {
+        Scheduler* m_Scheduler = nullptr;
+
+    public:
+        Slot(Scheduler* scheduler);
+        Slot(const Slot&) = delete;
+        ~Slot();
+
+        Slot& operator=(const Slot&) = delete;
+    };
+
+    // Gives the slot of the calling thread away for its lifetime, if it holds one.
+    class Blocking final {
+        Scheduler* m_Scheduler = nullptr;
+
+    public:
+        Blocking();
+        Blocking(const Blocking&) = delete;
+        ~Blocking();
+
+        Blocking& operator=(const Blocking&) = delete;
+    };
+
+    // Wait hook for host::sync, see host::sync::setWaitHook.
+    static void waitHook(bool blocked);
+};
+
+} // namespace dashle::guest
+
+#endif /* _DASHLE_GUEST_SCHEDULER_H */
@@ -0,0 +1,187 @@
+#include "DasHLE/Guest/Threads.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace dashle;
+using namespace dashle::guest;
+
+static thread_local u32 t_CurrentId = MAIN_THREAD_ID;
+static thread_local usize t_CurrentSlot = 0u;
+
+// ThreadManager
+
+struct Thread {
+    usize slot = 0u;
+    uaddr stackBase = 0u;
+    std::thread handle;
+    bool detached = false;
+    bool joining = false;
+    bool exited = false;
+    u64 result = 0u;
+};
+
+struct ThreadManager::Data {
+    std::mutex lock;
+    std::condition_variable exitCond;
+    VMFactory factory;
+    usize stackSize = 0u;
+    usize pageSize = 0u;
+    std::vector<bool> usedSlots;
+    std::unordered_map<u32, Thread> threads;
+    u32 nextId = MAIN_THREAD_ID + 1u;
+    usize running = 0u;
+
+    // Find a free exclusive monitor slot, slot 0 is never handed out.
+    Optional<usize> acquireSlot() {
+        for (auto i = 1u; i < usedSlots.size(); ++i) {
+            if (!usedSlots[i]) {
+                usedSlots[i] = true;
+                return i;
+            }
+        }
+
+        return {};
+    }
+};
+
+ThreadManager::ThreadManager(std::shared_ptr<host::memory::MemoryManager> mem, VMFactory factory, usize maxThreads, usize stackSize, usize pageSize)
+    : m_Mem(mem) {
+    DASHLE_ASSERT(m_Mem);
+    DASHLE_ASSERT(factory);
+    DASHLE_ASSERT(maxThreads);
+    m_Data = std::make_unique<Data>();
+    m_Data->factory = std::move(factory);
+    m_Data->stackSize = stackSize;
+    m_Data->pageSize = pageSize;
+    m_Data->usedSlots.resize(maxThreads);
+}
+
+ThreadManager::~ThreadManager() { waitAll(); }
+
+Expected<u32> ThreadManager::create(uaddr entry, u64 arg) {
+    std::scoped_lock lock(m_Data->lock);
+    DASHLE_TRY_OPTIONAL_CONST(slot, m_Data->acquireSlot(), Error::InvalidOperation);
+
+    // Only the pages the stack grows into get committed.
+    const auto stack = m_Mem->allocate({
+        .size = m_Data->stackSize,
+        .alignment = m_Data->pageSize,
+        .flags = host::memory::flags::PERM_READ_WRITE | host::memory::flags::LAZY_COMMIT,
+    });
+    if (!stack) {
+        m_Data->usedSlots[slot] = false;
+        return Unexpected(stack.error());
+    }
+
+    auto vm = m_Data->factory(slot);
+    DASHLE_ASSERT(vm);
+    vm->setStackPointer(stack.value()->virtualBase + stack.value()->size);
+    vm->setArgument(0u, arg);
+
+    const auto id = m_Data->nextId++;
+    auto& thread = m_Data->threads[id];
+    thread.slot = slot;
+    thread.stackBase = stack.value()->virtualBase;
+    ++m_Data->running;
+
+    thread.handle = std::thread([this, id, slot, entry, vm = std::move(vm)]() mutable {
+        t_CurrentId = id;
+        t_CurrentSlot = slot;
+        if (const auto reason = vm->execute(entry); reason != VM_EXEC_SUCCESS) {
+            DASHLE_UNREACHABLE("Thread failed (id={}, entry=0x{:X}, reason={})", id, entry, static_cast<u32>(reason));
+        }
+
+        const auto result = vm->returnValue();
+        vm.reset();
+
+        std::scoped_lock lock(m_Data->lock);
+        auto& thread = m_Data->threads[id];
+        DASHLE_ASSERT(m_Mem->free(thread.stackBase));
+        m_Data->usedSlots[thread.slot] = false;
+        thread.exited = true;
+        thread.result = result;
+
+        // Nobody is going to join detached threads, their handle is already detached.
+        if (thread.detached)
+            m_Data->threads.erase(id);
+
+        --m_Data->running;
+        m_Data->exitCond.notify_all();
+    });
+
+    return id;
+}
+
+Expected<u64> ThreadManager::join(u32 id) {
+    std::unique_lock lock(m_Data->lock);
+    auto it = m_Data->threads.find(id);
+    if (it == m_Data->threads.end())
+        return Unexpected(Error::NotFound);
+
+    if (id == currentId() || it->second.detached || it->second.joining)
+        return Unexpected(Error::InvalidOperation);
+
+    it->second.joining = true;
+    m_Data->exitCond.wait(lock, [&it]() { return it->second.exited; });
+
+    auto handle = std::move(it->second.handle);
+    const auto result = it->second.result;
+    m_Data->threads.erase(it);
+    lock.unlock();
+
+    handle.join();
+    return result;
+}
+
+Expected<void> ThreadManager::detach(u32 id) {
+    std::unique_lock lock(m_Data->lock);
+    auto it = m_Data->threads.find(id);
+    if (it == m_Data->threads.end())
+        return Unexpected(Error::NotFound);
+
+    if (it->second.detached || it->second.joining)
+        return Unexpected(Error::InvalidOperation);
+
+    // The thread is done, release it here.
+    if (it->second.exited) {
+        auto handle = std::move(it->second.handle);
+        m_Data->threads.erase(it);
+        lock.unlock();
+        handle.join();
+        return EXPECTED_VOID;
+    }
+
+    it->second.detached = true;
+    it->second.handle.detach();
+    return EXPECTED_VOID;
+}
+
+void ThreadManager::waitAll() {
+    std::vector<std::thread> handles;
+    {
+        std::unique_lock lock(m_Data->lock);
+        m_Data->exitCond.wait(lock, [this]() { return !m_Data->running; });
+
+        // Threads being joined are released by their joiner.
+        for (auto it = m_Data->threads.begin(); it != m_Data->threads.end();) {
+            if (it->second.joining) {
+                ++it;
+                continue;
+            }
+
+            handles.push_back(std::move(it->second.handle));
+            it = m_Data->threads.erase(it);
+        }
+    }
+
+    for (auto& handle : handles)
+        handle.join();
+}
+
+u32 ThreadManager::currentId() { return t_CurrentId; }
+
+usize ThreadManager::currentSlot() { return t_CurrentSlot; }
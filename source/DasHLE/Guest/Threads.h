@@ -0,0 +1,55 @@
+#ifndef _DASHLE_GUEST_THREADS_H
+#define _DASHLE_GUEST_THREADS_H
+
+#include "DasHLE/Host/Memory.h"
+#include "DasHLE/Guest/VM.h"
+
+#include <functional>
+#include <memory>
+
+namespace dashle::guest {
+
+// Id of the thread which loaded the binary, created threads get increasing ids.
+constexpr static u32 MAIN_THREAD_ID = 1u;
+
+// Runs guest threads in parallel, each one on its own host thread, VM and stack.
+// VMs share the memory, the bridge and the exclusive monitor, and take processor slots 1 to maxThreads - 1
+// (slot 0 belongs to the main thread).
+class ThreadManager final {
+public:
+    // Create a VM for the given exclusive monitor slot.
+    using VMFactory = std::function<std::unique_ptr<VM>(usize processorId)>;
+
+private:
+    struct Data;
+
+    std::shared_ptr<host::memory::MemoryManager> m_Mem;
+    std::unique_ptr<Data> m_Data;
+
+public:
+    ThreadManager(std::shared_ptr<host::memory::MemoryManager> mem, VMFactory factory, usize maxThreads, usize stackSize, usize pageSize);
+    ~ThreadManager();
+
+    // Start a thread running entry(arg), return its id.
+    Expected<u32> create(uaddr entry, u64 arg);
+
+    // Wait for a thread to exit, return the value returned by its entry.
+    Expected<u64> join(u32 id);
+
+    // Let a thread release its resources on exit, without being joined.
+    Expected<void> detach(u32 id);
+
+    // Wait for every thread to exit, detached ones included.
+    void waitAll();
+
+    // Id of the calling thread, MAIN_THREAD_ID for threads not started by a manager.
+    static u32 currentId();
+
+    // Processor slot of the calling thread, 0 for threads not started by a manager.
+    // Unlike ids, slots are reused once their thread exits, so they stay below maxThreads.
+    static usize currentSlot();
+};
+
+} // namespace dashle::guest
+
+#endif /* _DASHLE_GUEST_THREADS_H */
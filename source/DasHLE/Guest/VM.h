@@ -3,26 +3,110 @@
 
 #include "DasHLE/Dynarmic.h"
 #include "DasHLE/Host/Memory.h"
+#include "DasHLE/Guest/Profiler.h"
+#include "DasHLE/Guest/Scheduler.h"
 
+#include <array>
+#include <memory>
+#include <span>
 #include <type_traits>
 
 namespace dashle::guest {
 
 constexpr static auto VM_EXEC_SUCCESS = static_cast<dynarmic::HaltReason>(0u);
 
+// Reasons for guest code to return to the host, on top of dynarmic's own.
+namespace halt {
+
+constexpr static auto RETURNED = dynarmic::HaltReason::UserDefined1;   // Reached the end address of the call.
+constexpr static auto YIELD = dynarmic::HaltReason::UserDefined2;      // Requested by a host function, execution resumes right away.
+constexpr static auto WATCHDOG = dynarmic::HaltReason::UserDefined3;   // Ran for too long.
+constexpr static auto BREAKPOINT = dynarmic::HaltReason::UserDefined4; // Requested by a debugger.
+constexpr static auto SAMPLE = dynarmic::HaltReason::UserDefined5;     // Requested by the profiler, execution resumes right away.
+
+} // namespace dashle::guest::halt
+
+// Thread local storage is an array of pointer sized slots, laid out like bionic's: the thread pointer register
+// points to the first one. Slots below TLS_FIRST_KEY are reserved, the others are handed out as pthread keys.
+constexpr static usize TLS_SLOTS = 64u;
+constexpr static usize TLS_SLOT_SELF = 0u;
+constexpr static usize TLS_FIRST_KEY = 8u;
+
+// Guest functions may call host functions which call guest functions back, up to this many levels.
+constexpr static usize MAX_CALL_DEPTH = 8u;
+
+struct VMConfig {
+    usize codeCacheSize = 16u * 1024 * 1024;
+    usize nestedCodeCacheSize = 4u * 1024 * 1024; // Used by each level of nested calls, only callbacks run there.
+    bool hugeCodeCache = false; // Ask the host to back the code cache with transparent huge pages.
+
+    // Guest threads may run in parallel on VMs sharing the exclusive monitor, each one in its own processor slot.
+    // A monitor sized to maxThreads is created if none is given.
+    usize maxThreads = 1u;
+    std::shared_ptr<dynarmic::ExclusiveMonitor> exclusiveMonitor = {};
+    usize processorId = 0u;
+
+    // Counts cycles and lets threads take turns on the scheduler's slots, threads run freely if none is given.
+    std::shared_ptr<Scheduler> scheduler = {};
+
+    // Samples the guest stack when asked to by the profiler, VMs attach themselves on creation.
+    std::shared_ptr<Profiler> profiler = {};
+
+    // Counts the executions of each block of guest code, at the cost of a host call per block.
+    std::shared_ptr<BlockCounters> blockCounters = {};
+};
+
 class VM {
+    static inline thread_local VM* s_Current = nullptr;
+
+protected:
+    // Must be called by execute() and step().
+    void makeCurrent() { s_Current = this; }
+
 public:
     virtual ~VM() {}
 
+    // VM which last ran guest code on the calling thread.
+    static VM* current() { return s_Current; }
+
     virtual dynarmic::HaltReason execute(Optional<uaddr> addr = {}) = 0;
     virtual dynarmic::HaltReason step(Optional<uaddr> addr = {}) = 0;
 
+    // Make the innermost running guest code return to the host, must be called from the thread running the VM.
+    virtual void halt(dynarmic::HaltReason reason) = 0;
+
+    // Same as halt(), but may be called from any thread. Guest code which isn't running gets it once it runs again.
+    virtual void interrupt(dynarmic::HaltReason reason) {}
+
     virtual void clearCache() = 0;
     virtual void invalidateCache(uaddr addr, usize size) = 0;
 
+    // Register ids go from 0 to numRegisters() - 1.
+    virtual usize numRegisters() const = 0;
     virtual void setRegister(usize id, u64 value) = 0;
     virtual u64 getRegister(usize id) const = 0;
 
+    // Calling convention, used to start guest functions from the host. Only register arguments are supported.
+    virtual void setStackPointer(uaddr sp) = 0;
+    virtual void setArgument(usize index, u64 value) = 0;
+    virtual u64 returnValue() const = 0;
+
+    // Call a guest function with register arguments and return its result, the caller's context is left untouched.
+    // Host functions called by the guest may use this to run callbacks.
+    virtual Expected<u64> callFunction(uaddr addr, std::span<const u64> args) = 0;
+
+    template <std::convertible_to<u64>... Args>
+    Expected<u64> call(uaddr addr, Args... args) {
+        const std::array<u64, sizeof...(Args)> values = { static_cast<u64>(args)... };
+        return callFunction(addr, values);
+    }
+
+    // Guest address of the thread local storage slots, owned by the VM.
+    virtual uaddr tlsBase() const = 0;
+
+    // Number of huge pages backing the code cache.
+    virtual usize codeCacheHugePages() const { return 0u; }
+
     virtual void dumpContext() const {}
 };
 
@@ -0,0 +1,200 @@
+#ifndef _DASHLE_HOST_AAPCS_H
+#define _DASHLE_HOST_AAPCS_H
+
+#include "DasHLE/Host/Memory.h"
+
+#include <array>
+#include <bit>
+#include <type_traits>
+#include <utility>
+
+namespace dashle::host::bridge {
+
+// Guest state seen by host functions called by 32 bit guests, owned by the VM.
+struct GuestContext32 {
+    std::array<u32, 16>* regs = nullptr;
+    std::array<u32, 64>* extRegs = nullptr; // S0-S31, D registers are pairs of them.
+    memory::MemoryManager* mem = nullptr;
+};
+
+namespace aapcs {
+
+enum class FloatABI {
+    Soft, // Floating point values go through core registers (softfp, Android's armeabi-v7a).
+    Hard, // Floating point values go through VFP registers.
+};
+
+// Host functions may only take and return scalars, guest pointers are passed as integers.
+template <typename T>
+concept Scalar = (std::is_arithmetic_v<T> || std::is_enum_v<T>) && (sizeof(T) <= 8u);
+
+enum class Where {
+    Core,   // Index of the first core register.
+    Stack,  // Offset from the stack pointer.
+    Single, // Index of the S register.
+    Double, // Index of the first S register.
+};
+
+struct Location {
+    Where where = Where::Core;
+    usize index = 0u;
+
+    constexpr bool operator==(const Location&) const = default;
+};
+
+// Locations of the arguments, computed at compile time following the AAPCS (variadic functions excluded).
+template <FloatABI ABI, Scalar... Args>
+consteval std::array<Location, sizeof...(Args)> layout() {
+    std::array<Location, sizeof...(Args)> locations = {};
+
+    if constexpr (sizeof...(Args) > 0u) {
+        constexpr usize NUM_CORE_REGS = 4u;
+        constexpr usize NUM_VFP_REGS = 16u;
+
+        std::array<bool, NUM_VFP_REGS> usedVFP = {};
+        usize ncrn = 0u; // Next core register.
+        usize nsaa = 0u; // Next stacked argument offset.
+        usize i = 0u;
+
+        const auto stack = [&nsaa](usize size) {
+            nsaa = (nsaa + size - 1u) & ~(size - 1u);
+            const auto location = Location { .where = Where::Stack, .index = nsaa };
+            nsaa += size;
+            return location;
+        };
+
+        // VFP candidates are back-filled, until one of them goes on the stack.
+        const auto vfp = [&](usize count) -> Optional<usize> {
+            for (auto reg = 0u; reg + count <= NUM_VFP_REGS; reg += count) {
+                if (!usedVFP[reg] && (count == 1u || !usedVFP[reg + 1u])) {
+                    for (auto j = 0u; j < count; ++j)
+                        usedVFP[reg + j] = true;
+
+                    return reg;
+                }
+            }
+
+            usedVFP.fill(true);
+            return {};
+        };
+
+        ([&]<typename T>() {
+            constexpr auto size = sizeof(T) <= 4u ? 4u : 8u;
+
+            if constexpr (ABI == FloatABI::Hard && std::is_floating_point_v<T>) {
+                constexpr auto count = size / 4u;
+                if (const auto reg = vfp(count)) {
+                    locations[i++] = Location { .where = count == 1u ? Where::Single : Where::Double, .index = *reg };
+                } else {
+                    locations[i++] = stack(size);
+                }
+            } else {
+                // 64 bit values go in an even register pair, or on the stack.
+                if (size == 8u)
+                    ncrn = (ncrn + 1u) & ~static_cast<usize>(1u);
+
+                if (ncrn + size / 4u <= NUM_CORE_REGS) {
+                    locations[i++] = Location { .where = Where::Core, .index = ncrn };
+                    ncrn += size / 4u;
+                } else {
+                    ncrn = NUM_CORE_REGS;
+                    locations[i++] = stack(size);
+                }
+            }
+        }.template operator()<Args>(), ...);
+    }
+
+    return locations;
+}
+
+template <Scalar T>
+T fromBits(u64 bits) {
+    if constexpr (std::is_same_v<T, float>) {
+        return std::bit_cast<float>(static_cast<u32>(bits));
+    } else if constexpr (std::is_same_v<T, double>) {
+        return std::bit_cast<double>(bits);
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return static_cast<u8>(bits);
+    } else {
+        // Narrow integers are truncated, whatever the caller left in the upper bits.
+        return static_cast<T>(bits);
+    }
+}
+
+template <Scalar T>
+u64 toBits(T value) {
+    if constexpr (std::is_same_v<T, float>) {
+        return std::bit_cast<u32>(value);
+    } else if constexpr (std::is_same_v<T, double>) {
+        return std::bit_cast<u64>(value);
+    } else if constexpr (sizeof(T) <= 4u && std::is_signed_v<T>) {
+        return static_cast<u32>(static_cast<s32>(value));
+    } else {
+        return static_cast<u64>(value);
+    }
+}
+
+template <Scalar T, Location LOCATION>
+T readArgument(const GuestContext32& ctx) {
+    const auto& regs = *ctx.regs;
+    const auto& extRegs = *ctx.extRegs;
+
+    if constexpr (LOCATION.where == Where::Core) {
+        if constexpr (sizeof(T) == 8u) {
+            return fromBits<T>(regs[LOCATION.index] | (static_cast<u64>(regs[LOCATION.index + 1u]) << 32u));
+        } else {
+            return fromBits<T>(regs[LOCATION.index]);
+        }
+    } else if constexpr (LOCATION.where == Where::Single) {
+        return fromBits<T>(extRegs[LOCATION.index]);
+    } else if constexpr (LOCATION.where == Where::Double) {
+        return fromBits<T>(extRegs[LOCATION.index] | (static_cast<u64>(extRegs[LOCATION.index + 1u]) << 32u));
+    } else {
+        constexpr usize SP = 13u;
+        constexpr auto size = sizeof(T) <= 4u ? 4u : 8u;
+        u64 bits = 0u;
+        DASHLE_ASSERT(ctx.mem->read(regs[SP] + LOCATION.index, &bits, size));
+        return fromBits<T>(bits);
+    }
+}
+
+template <FloatABI ABI, Scalar T>
+void writeResult(GuestContext32& ctx, T value) {
+    const auto bits = toBits(value);
+
+    if constexpr (ABI == FloatABI::Hard && std::is_floating_point_v<T>) {
+        (*ctx.extRegs)[0] = static_cast<u32>(bits);
+        if constexpr (sizeof(T) == 8u)
+            (*ctx.extRegs)[1] = static_cast<u32>(bits >> 32u);
+    } else {
+        (*ctx.regs)[0] = static_cast<u32>(bits);
+        if constexpr (sizeof(T) == 8u)
+            (*ctx.regs)[1] = static_cast<u32>(bits >> 32u);
+    }
+}
+
+template <auto FN, FloatABI ABI, typename R, Scalar... Args>
+requires (std::is_void_v<R> || Scalar<R>)
+void invoke(GuestContext32& ctx, R(*)(Args...)) {
+    constexpr static auto LOCATIONS = layout<ABI, Args...>();
+
+    [&ctx]<usize... I>(std::index_sequence<I...>) {
+        if constexpr (std::is_void_v<R>) {
+            FN(readArgument<Args, LOCATIONS[I]>(ctx)...);
+        } else {
+            writeResult<ABI>(ctx, FN(readArgument<Args, LOCATIONS[I]>(ctx)...));
+        }
+    }(std::index_sequence_for<Args...>{});
+}
+
+// Called by the Jit in place of the guest function, arguments and results are marshalled in place.
+template <auto FN, FloatABI ABI>
+void call(u64 context) {
+    invoke<FN, ABI>(*reinterpret_cast<GuestContext32*>(context), FN);
+}
+
+} // namespace dashle::host::bridge::aapcs
+
+} // namespace dashle::host::bridge
+
+#endif /* _DASHLE_HOST_AAPCS_H */
@@ -1,5 +1,7 @@
 #include "DasHLE/Host/Bridge.h"
 
+#include <algorithm>
+
 using namespace dashle;
 using namespace dashle::host::bridge;
 
@@ -18,28 +20,41 @@ Expected<void> Bridge::registerFunctionImpl(const std::string& symbol, Emitter e
     if (hasSymbol(symbol))
         return Unexpected(Error::Duplicate);
 
-    const auto vaddr = m_FuncEntries.size() * ENTRY_SIZE;
-    m_FuncEntries[symbol] = vaddr;
-    m_Emitters[vaddr] = emitter;
+    m_FuncEntries[symbol] = m_Emitters.size() * ENTRY_SIZE;
+    m_Emitters.push_back(emitter);
     return EXPECTED_VOID;
 }
 
-template <typename IR>
+void Bridge::freezeSymbols() {
+    m_Symbols.clear();
+    m_Symbols.reserve(m_FuncEntries.size() + m_VarEntries.size());
+    for (const auto& entries : { &m_FuncEntries, &m_VarEntries }) {
+        for (const auto& [name, vaddr] : *entries)
+            m_Symbols.push_back({ name, vaddr });
+    }
+
+    std::sort(m_Symbols.begin(), m_Symbols.end(), [](const SymbolEntry& a, const SymbolEntry& b) {
+        return a.name < b.name;
+    });
+}
+
+template <typename IR, typename... Args>
 requires (OneOf<IR, dynarmic32::IREmitter*, dynarmic64::IREmitter*>)
-Expected<void> Bridge::invokeEmitterImpl(uaddr vaddr, IR ir) {
+Expected<void> Bridge::invokeEmitterImpl(uaddr vaddr, IR ir, Args... args) {
     if (!hasBuiltIFT())
         return Unexpected(Error::InvalidOperation);
 
-    if (auto it = m_Emitters.find(vaddr); it != m_Emitters.end()) {
-        it->second.invoke(ir);
-        return EXPECTED_VOID;
-    }
+    // Jumps in the middle of an entry are not calls.
+    const auto offset = vaddr - m_IFTBase;
+    if (!isIFTAddress(vaddr) || (offset % ENTRY_SIZE))
+        return Unexpected(Error::NotFound);
 
-    return Unexpected(Error::NotFound);
+    m_Emitters[offset / ENTRY_SIZE].invoke(ir, args...);
+    return EXPECTED_VOID;
 }
 
-Bridge::Bridge(std::shared_ptr<host::memory::MemoryManager> mem, usize bitness)
-    : m_Mem(mem), m_Bitness(bitness) {
+Bridge::Bridge(std::shared_ptr<host::memory::MemoryManager> mem, usize bitness, aapcs::FloatABI floatABI)
+    : m_Mem(mem), m_Bitness(bitness), m_FloatABI(floatABI) {
     DASHLE_ASSERT(m_Bitness == dashle::BITS_32 || m_Bitness == dashle::BITS_64);
 }
 
@@ -70,6 +85,7 @@ Expected<void> Bridge::buildIFT() {
     // Handle the case when we dont have functions.
     if (m_FuncEntries.empty()) {
         m_IFTBase = IFT_NO_FUNC;
+        freezeSymbols();
         return EXPECTED_VOID;
     }
 
@@ -77,42 +93,41 @@ Expected<void> Bridge::buildIFT() {
     // You can imagine as if the whole function is contained within its entry address, the Jit will jump to the
     // correct function when executing from one of the entries. 
     DASHLE_TRY_EXPECTED_CONST(block, m_Mem->allocate({
-        .size = m_FuncEntries.size() * ENTRY_SIZE,
+        .size = m_Emitters.size() * ENTRY_SIZE,
         .alignment = ENTRY_SIZE,
         .flags = 0u,
     }));
 
     m_IFTBase = block->virtualBase;
+    m_IFTSize = m_Emitters.size() * ENTRY_SIZE;
 
-    // Rebase addresses.
+    // Rebase addresses, emitters keep their index.
     for (auto &[_, value] : m_FuncEntries)
         value += m_IFTBase;
 
-    EmitterMap emitters;
-    while (m_Emitters.begin() != m_Emitters.end()) {
-        auto node = m_Emitters.extract(m_Emitters.begin());
-        emitters.insert({ m_IFTBase + node.key(), node.mapped() });
-    }
-    m_Emitters = std::move(emitters);
+    m_Emitters.shrink_to_fit();
+    freezeSymbols();
 
     return EXPECTED_VOID;
 }
 
-Expected<uaddr> Bridge::addressForSymbol(const std::string& symbol) {
+Expected<uaddr> Bridge::addressForSymbol(std::string_view symbol) const {
     if (!hasBuiltIFT())
         return Unexpected(Error::InvalidOperation);
 
-    if (auto it = m_FuncEntries.find(symbol); it != m_FuncEntries.end())
-        return it->second;
+    const auto it = std::lower_bound(m_Symbols.begin(), m_Symbols.end(), symbol, [](const SymbolEntry& entry, std::string_view name) {
+        return entry.name < name;
+    });
 
-    if (auto it = m_VarEntries.find(symbol); it != m_VarEntries.end())
-        return it->second;
+    if (it != m_Symbols.end() && it->name == symbol)
+        return it->vaddr;
 
     return Unexpected(Error::NotFound);
 }
 
-Expected<void> Bridge::emitCall(uaddr vaddr, dynarmic32::IREmitter* ir) {
-    return invokeEmitterImpl(vaddr, ir);
+Expected<void> Bridge::emitCall(uaddr vaddr, dynarmic32::IREmitter* ir, GuestContext32* ctx) {
+    DASHLE_ASSERT(ctx);
+    return invokeEmitterImpl(vaddr, ir, ctx);
 }
 
 Expected<void> Bridge::emitCall(uaddr vaddr, dynarmic64::IREmitter* ir) {
@@ -2,16 +2,19 @@
 #define _DASHLE_HOST_BRIDGE_H
 
 #include "DasHLE/Dynarmic.h"
+#include "DasHLE/Host/AAPCS.h"
 #include "DasHLE/Host/Memory.h"
 
+#include <string_view>
 #include <unordered_map>
 #include <variant>
+#include <vector>
 
 namespace dashle::host::bridge {
 
 class Bridge final {
     class Emitter final {
-        using Emitter32 = void(*)(dynarmic32::IREmitter*);
+        using Emitter32 = void(*)(dynarmic32::IREmitter*, GuestContext32*);
         using Emitter64 = void(*)(dynarmic64::IREmitter*);
 
         std::variant<Emitter32, Emitter64> m_Emitter;
@@ -21,9 +24,9 @@ class Bridge final {
         Emitter(Emitter32 emitter) : m_Emitter(emitter) {}
         Emitter(Emitter64 emitter) : m_Emitter(emitter) {}
 
-        void invoke(dynarmic32::IREmitter* ir) const {
+        void invoke(dynarmic32::IREmitter* ir, GuestContext32* ctx) const {
             DASHLE_ASSERT(std::holds_alternative<Emitter32>(m_Emitter));
-            std::get<Emitter32>(m_Emitter)(ir);
+            std::get<Emitter32>(m_Emitter)(ir, ctx);
         }
 
         void invoke(dynarmic64::IREmitter* ir) const {
@@ -33,19 +36,26 @@ class Bridge final {
     };
 
     using SymbolMap = std::unordered_map<std::string, uaddr>;
-    using EmitterMap = std::unordered_map<uaddr, Emitter>;
+
+    struct SymbolEntry {
+        std::string_view name; // Owned by the symbol maps.
+        uaddr vaddr;
+    };
 
     std::shared_ptr<host::memory::MemoryManager> m_Mem;
     const usize m_Bitness;
+    const aapcs::FloatABI m_FloatABI;
     uaddr m_IFTBase = 0u;
+    usize m_IFTSize = 0u;
     SymbolMap m_FuncEntries;
     SymbolMap m_VarEntries;
-    EmitterMap m_Emitters;
+    std::vector<Emitter> m_Emitters; // Indexed by IFT entry.
+    std::vector<SymbolEntry> m_Symbols; // Functions and variables sorted by name, frozen by buildIFT.
 
-    template <auto FN>
-    static void emitCall32(dynarmic32::IREmitter* ir) {
-        // TODO
-        // ir->CallHostFunctionWithGuestABI(FN);
+    // The block only holds a direct call to the marshalling thunk, which reads the guest registers in place.
+    template <auto FN, aapcs::FloatABI ABI>
+    static void emitCall32(dynarmic32::IREmitter* ir, GuestContext32* ctx) {
+        ir->CallHostFunction(&aapcs::call<FN, ABI>, ir->Imm64(reinterpret_cast<u64>(ctx)));
         ir->BXWritePC(ir->GetRegister(dynarmic32::Reg::LR));
         ir->SetTerm(dynarmic_ir::Term::ReturnToDispatch{});
     }
@@ -56,13 +66,14 @@ class Bridge final {
     }
 
     Expected<void> registerFunctionImpl(const std::string& symbol, Emitter emitter);
+    void freezeSymbols();
 
-    template <typename IR>
+    template <typename IR, typename... Args>
     requires (OneOf<IR, dynarmic32::IREmitter*, dynarmic64::IREmitter*>)
-    Expected<void> invokeEmitterImpl(uaddr vaddr, IR ir);
+    Expected<void> invokeEmitterImpl(uaddr vaddr, IR ir, Args... args);
 
 public:
-    Bridge(std::shared_ptr<host::memory::MemoryManager> mem, usize bitness);
+    Bridge(std::shared_ptr<host::memory::MemoryManager> mem, usize bitness, aapcs::FloatABI floatABI = aapcs::FloatABI::Soft);
     ~Bridge();
 
     // Register a host function to be called from the Jit.
@@ -70,7 +81,8 @@ public:
     Expected<void> registerFunction(const std::string& symbol) {
         if constexpr (BITS & dashle::BITS_32) {
             if (m_Bitness & dashle::BITS_32) {
-                DASHLE_TRY_EXPECTED_VOID(registerFunctionImpl(symbol, &emitCall32<FN>));
+                const auto emitter = m_FloatABI == aapcs::FloatABI::Hard ? &emitCall32<FN, aapcs::FloatABI::Hard> : &emitCall32<FN, aapcs::FloatABI::Soft>;
+                DASHLE_TRY_EXPECTED_VOID(registerFunctionImpl(symbol, emitter));
             }
         }
 
@@ -90,15 +102,19 @@ public:
     Expected<void> buildIFT();
     bool hasBuiltIFT() const { return m_IFTBase != 0u; }
 
+    // Single range check done before any lookup, so compiling guest code stays cheap.
+    bool isIFTAddress(uaddr vaddr) const { return (vaddr - m_IFTBase) < m_IFTSize; }
+
     bool hasSymbol(const std::string& symbol) const {
         return m_FuncEntries.contains(symbol) || m_VarEntries.contains(symbol);
     }
 
     // Return the virtual address used by the Jit to access a function/variable.
-    Expected<uaddr> addressForSymbol(const std::string& symbol);
+    Expected<uaddr> addressForSymbol(std::string_view symbol) const;
 
-    // Used by the Jit to generate the code calling into host functions. 
-    Expected<void> emitCall(uaddr vaddr, dynarmic32::IREmitter* ir);
+    // Used by the Jit to generate the code calling into host functions.
+    // The context must outlive the generated code.
+    Expected<void> emitCall(uaddr vaddr, dynarmic32::IREmitter* ir, GuestContext32* ctx);
     Expected<void> emitCall(uaddr vaddr, dynarmic64::IREmitter* ir);
 };
 
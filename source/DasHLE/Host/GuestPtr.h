@@ -0,0 +1,100 @@
+#ifndef _DASHLE_HOST_GUESTPTR_H
+#define _DASHLE_HOST_GUESTPTR_H
+
+#include "DasHLE/Host/Memory.h"
+
+#include <span>
+#include <type_traits>
+
+namespace dashle::host::memory {
+
+// Guest pointer of the given width.
+template <usize BITS>
+requires (BITS == BITS_32 || BITS == BITS_64)
+using GuestAddr = std::conditional_t<BITS == BITS_32, u32, u64>;
+
+// Contiguous guest objects, translated and bounds checked once against the containing block.
+// Access is unchecked afterwards, so views must not outlive the block (nor its flags).
+// Const views require readable memory, the others readable and writable memory.
+// Guest objects may be unaligned, which is tolerated by every supported host.
+template <typename T>
+requires (std::is_trivially_copyable_v<std::remove_const_t<T>>)
+class GuestSpan {
+    uaddr m_VAddr = 0u;
+    T* m_Data = nullptr;
+    usize m_Size = 0u;
+
+public:
+    GuestSpan() {}
+
+    static Expected<GuestSpan> from(const MemoryManager& mem, uaddr vaddr, usize size) {
+        constexpr auto perms = std::is_const_v<T> ? flags::PERM_READ : flags::PERM_READ_WRITE;
+
+        DASHLE_TRY_EXPECTED_CONST(block, mem.blockFromVAddr(vaddr));
+        if ((block.flags & perms) != perms)
+            return Unexpected(Error::PermissionDenied);
+
+        if (size > (block.virtualBase + block.size - vaddr) / sizeof(T))
+            return Unexpected(Error::InvalidSize);
+
+        GuestSpan span;
+        span.m_VAddr = vaddr;
+        span.m_Data = reinterpret_cast<T*>(block.hostBase + (vaddr - block.virtualBase));
+        span.m_Size = size;
+        return span;
+    }
+
+    uaddr vaddr() const { return m_VAddr; }
+    T* data() const { return m_Data; }
+    usize size() const { return m_Size; }
+    bool empty() const { return !m_Size; }
+
+    T* begin() const { return m_Data; }
+    T* end() const { return m_Data + m_Size; }
+
+    T& operator[](usize index) const {
+        DASHLE_ASSERT(index < m_Size);
+        return m_Data[index];
+    }
+
+    // Guest address of an element.
+    uaddr vaddrOf(usize index) const { return m_VAddr + index * sizeof(T); }
+
+    std::span<T> span() const { return std::span<T>(m_Data, m_Size); }
+};
+
+// Single guest object, see GuestSpan.
+template <typename T>
+requires (std::is_trivially_copyable_v<std::remove_const_t<T>>)
+class GuestPtr {
+    GuestSpan<T> m_Span;
+
+public:
+    GuestPtr() {}
+
+    static Expected<GuestPtr> from(const MemoryManager& mem, uaddr vaddr) {
+        DASHLE_TRY_EXPECTED(span, GuestSpan<T>::from(mem, vaddr, 1u));
+        GuestPtr ptr;
+        ptr.m_Span = std::move(span);
+        return ptr;
+    }
+
+    uaddr vaddr() const { return m_Span.vaddr(); }
+    T* get() const { return m_Span.data(); }
+
+    T& operator*() const {
+        DASHLE_ASSERT(get());
+        return *get();
+    }
+
+    T* operator->() const {
+        DASHLE_ASSERT(get());
+        return get();
+    }
+
+    explicit operator bool() const { return get(); }
+};
+
+} // namespace dashle::host::memory
+
+#endif /* _DASHLE_HOST_GUESTPTR_H */
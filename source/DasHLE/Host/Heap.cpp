@@ -0,0 +1,596 @@
+#include "DasHLE/Support/Math.h"
+#include "DasHLE/Host/Heap.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace dashle;
+using namespace dashle::host::heap;
+
+namespace memory = dashle::host::memory;
+
+// Size classes: 16 bytes steps up to 128, then 4 classes for each power of two up to MAX_SMALL_SIZE.
+constexpr static usize NUM_LINEAR_CLASSES = 128u / MIN_ALIGNMENT;
+constexpr static usize NUM_CLASSES = NUM_LINEAR_CLASSES + 4u * (std::bit_width(MAX_SMALL_SIZE) - std::bit_width(128u));
+
+constexpr static usize sizeClassIndex(usize size) {
+    if (size <= 128u)
+        return (size - 1u) / MIN_ALIGNMENT;
+
+    const auto log = std::bit_width(size - 1u) - 1u;
+    return NUM_LINEAR_CLASSES + (log - 7u) * 4u + ((size - 1u) >> (log - 2u)) - 4u;
+}
+
+constexpr static auto CLASS_SIZES = [] {
+    std::array<usize, NUM_CLASSES> sizes = {};
+    for (auto size = MIN_ALIGNMENT; size <= MAX_SMALL_SIZE; size += MIN_ALIGNMENT)
+        sizes[sizeClassIndex(size)] = size;
+
+    return sizes;
+}();
+
+static_assert(sizeClassIndex(MAX_SMALL_SIZE) == NUM_CLASSES - 1u);
+static_assert(CLASS_SIZES[sizeClassIndex(129u)] == 160u);
+static_assert(CLASS_SIZES[sizeClassIndex(257u)] == 320u);
+
+constexpr static usize SLABS_PER_ARENA = ARENA_SIZE / SLAB_SIZE;
+static_assert(dashle::isPowerOfTwo(ARENA_SIZE) && dashle::isPowerOfTwo(SLAB_SIZE) && SLABS_PER_ARENA > 1u);
+
+constexpr static usize CACHE_SIZE = 32u; // Objects cached per size class and thread.
+constexpr static usize ALLOCATED_WORDS = SLAB_SIZE / MIN_ALIGNMENT / 64u;
+constexpr static auto NO_OBJECT = static_cast<u32>(-1);
+
+// Ids are never reused, so that thread caches can't be mistaken for the ones of a dead heap.
+static std::atomic<u64> g_NextHeapId = 1u;
+
+namespace {
+
+struct Slab {
+    uaddr base = 0u;
+    std::atomic<u32> sizeClass = 0u; // Read without lock when freeing.
+    u32 capacity = 0u;               // 0 if the slab is unused.
+    u32 numUsed = 0u;
+    u32 numInitialized = 0u;         // Objects past this index have never been handed out.
+    u32 freeHead = NO_OBJECT;        // Free objects are linked by index, the next one is stored in the object.
+    u32 dirtyEnd = 0u;               // Bytes past this offset were never handed out, so they are still zeroed.
+    Slab* prev = nullptr;            // Links in the partial list for the size class.
+    Slab* next = nullptr;
+    // One bit per object handed out and not freed yet (cached objects are free), updated without lock.
+    std::array<std::atomic<u64>, ALLOCATED_WORDS> allocated = {};
+
+    // Return whether the object was allocated before.
+    bool markAllocated(uaddr vaddr, bool isAllocated) {
+        const auto index = (vaddr - base) / CLASS_SIZES[sizeClass.load(std::memory_order_relaxed)];
+        const auto bit = static_cast<u64>(1u) << (index % 64u);
+        auto& word = allocated[index / 64u];
+        const auto old = isAllocated ? word.fetch_or(bit, std::memory_order_relaxed) : word.fetch_and(~bit, std::memory_order_relaxed);
+        return old & bit;
+    }
+};
+
+struct Arena {
+    uaddr base = 0u;
+    uaddr hostBase = 0u;
+    std::array<Slab, SLABS_PER_ARENA> slabs;
+
+    uaddr hostAddr(uaddr vaddr) const { return vaddr - base + hostBase; }
+};
+
+struct ThreadCache {
+    struct Bin {
+        usize count = 0u;
+        usize numZeroed = 0u; // Objects at the bottom which were never handed out.
+        std::array<uaddr, CACHE_SIZE> objects;
+    };
+
+    std::array<Bin, NUM_CLASSES> bins;
+};
+
+struct ThreadCacheSlot {
+    u64 heapId = 0u;
+    ThreadCache* cache = nullptr;
+};
+
+thread_local ThreadCacheSlot t_CacheSlot;
+
+// Set for threads which got a cache from any heap.
+thread_local bool t_HasCaches = false;
+
+} // anonymous namespace
+
+struct dashle::host::heap::HeapSnapshot {
+    // Slabs are referenced by index, arena index * SLABS_PER_ARENA + slab index.
+    constexpr static auto NO_SLAB = static_cast<usize>(-1);
+
+    struct SlabState {
+        u32 sizeClass;
+        u32 capacity;
+        u32 numUsed;
+        u32 numInitialized;
+        u32 freeHead;
+        u32 dirtyEnd;
+        usize prev;
+        usize next;
+        std::array<u64, ALLOCATED_WORDS> allocated;
+    };
+
+    std::vector<uaddr> arenas;
+    std::vector<SlabState> slabs;
+    std::vector<usize> freeSlabs;
+    std::array<usize, NUM_CLASSES> partialSlabs;
+    std::vector<uaddr> largeBlocks;
+    std::vector<uaddr> cachedObjects; // Returned to their slabs on restore.
+};
+
+struct dashle::host::heap::GuestHeap::Data {
+    // Caches of exiting threads go back to every live heap.
+    struct ThreadExitHook {
+        ~ThreadExitHook() {
+            if (!t_HasCaches)
+                return;
+
+            std::scoped_lock guard(s_HeapsLock);
+            for (const auto heap : s_Heaps)
+                heap->releaseThreadCache(std::this_thread::get_id());
+
+            t_CacheSlot = {};
+        }
+    };
+
+    static inline std::mutex s_HeapsLock;
+    static inline std::vector<Data*> s_Heaps;
+    static inline thread_local ThreadExitHook s_ThreadExitHook;
+
+    const u64 id = g_NextHeapId++;
+    std::mutex lock;
+    // Arena containing an address, indexed by address / ARENA_SIZE.
+    std::vector<std::atomic<Arena*>> arenaTable;
+    std::vector<std::unique_ptr<Arena>> arenas;
+    std::vector<Slab*> freeSlabs;
+    std::array<Slab*, NUM_CLASSES> partialSlabs = {};
+    std::unordered_set<uaddr> largeBlocks;
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadCache>> threadCaches;
+
+    Data(usize maxMemory) : arenaTable((maxMemory + ARENA_SIZE - 1u) / ARENA_SIZE) {}
+
+    Arena* arenaFromVAddr(uaddr vaddr) const {
+        const auto index = vaddr / ARENA_SIZE;
+        if (index < arenaTable.size())
+            return arenaTable[index].load(std::memory_order_acquire);
+
+        return nullptr;
+    }
+
+    ThreadCache& threadCache() {
+        if (t_CacheSlot.heapId != id) {
+            std::scoped_lock guard(lock);
+            auto& cache = threadCaches[std::this_thread::get_id()];
+            if (!cache) {
+                cache = std::make_unique<ThreadCache>();
+                // Construct the hook, so that the cache is released on exit.
+                static_cast<void>(s_ThreadExitHook);
+                t_HasCaches = true;
+            }
+
+            t_CacheSlot = ThreadCacheSlot {
+                .heapId = id,
+                .cache = cache.get(),
+            };
+        }
+
+        return *t_CacheSlot.cache;
+    }
+
+    void linkPartial(Slab* slab) {
+        auto& head = partialSlabs[slab->sizeClass.load(std::memory_order_relaxed)];
+        slab->prev = nullptr;
+        slab->next = head;
+        if (head)
+            head->prev = slab;
+
+        head = slab;
+    }
+
+    void unlinkPartial(Slab* slab) {
+        if (slab->prev) {
+            slab->prev->next = slab->next;
+        } else {
+            partialSlabs[slab->sizeClass.load(std::memory_order_relaxed)] = slab->next;
+        }
+
+        if (slab->next)
+            slab->next->prev = slab->prev;
+
+        slab->prev = slab->next = nullptr;
+    }
+
+    Expected<void> newArena(memory::MemoryManager* mem) {
+        DASHLE_TRY_EXPECTED_CONST(block, mem->allocate({
+            .size = ARENA_SIZE,
+            .alignment = ARENA_SIZE,
+            .flags = memory::flags::PERM_READ_WRITE | memory::flags::LAZY_COMMIT,
+        }));
+
+        auto arena = std::make_unique<Arena>();
+        arena->base = block->virtualBase;
+        arena->hostBase = block->hostBase;
+        for (auto i = 0u; i < SLABS_PER_ARENA; ++i)
+            arena->slabs[i].base = arena->base + i * SLAB_SIZE;
+
+        // Lowest slabs are used first.
+        for (auto it = arena->slabs.rbegin(); it != arena->slabs.rend(); ++it)
+            freeSlabs.push_back(&*it);
+
+        arenaTable[arena->base / ARENA_SIZE].store(arena.get(), std::memory_order_release);
+        arenas.push_back(std::move(arena));
+        return EXPECTED_VOID;
+    }
+
+    // Arenas are lazily committed, so objects past the dirty end of their slab are zeroed.
+    Expected<uaddr> popObject(memory::MemoryManager* mem, usize sizeClass, bool& zeroed) {
+        auto slab = partialSlabs[sizeClass];
+        if (!slab) {
+            if (freeSlabs.empty())
+                DASHLE_TRY_EXPECTED_VOID(newArena(mem));
+
+            slab = freeSlabs.back();
+            freeSlabs.pop_back();
+            slab->sizeClass.store(sizeClass, std::memory_order_relaxed);
+            slab->capacity = SLAB_SIZE / CLASS_SIZES[sizeClass];
+            slab->numUsed = 0u;
+            slab->numInitialized = 0u;
+            slab->freeHead = NO_OBJECT;
+            linkPartial(slab);
+        }
+
+        u32 index = 0u;
+        if (slab->freeHead != NO_OBJECT) {
+            index = slab->freeHead;
+            const auto arena = arenaFromVAddr(slab->base);
+            slab->freeHead = *reinterpret_cast<const u32*>(arena->hostAddr(slab->base + index * CLASS_SIZES[sizeClass]));
+        } else {
+            index = slab->numInitialized++;
+        }
+
+        if (++slab->numUsed == slab->capacity)
+            unlinkPartial(slab);
+
+        const auto offset = static_cast<u32>(index * CLASS_SIZES[sizeClass]);
+        zeroed = offset >= slab->dirtyEnd;
+        slab->dirtyEnd = std::max(slab->dirtyEnd, static_cast<u32>(offset + CLASS_SIZES[sizeClass]));
+        return slab->base + offset;
+    }
+
+    void pushObject(Arena* arena, Slab* slab, uaddr vaddr) {
+        const auto sizeClass = slab->sizeClass.load(std::memory_order_relaxed);
+        const auto index = static_cast<u32>((vaddr - slab->base) / CLASS_SIZES[sizeClass]);
+        *reinterpret_cast<u32*>(arena->hostAddr(vaddr)) = slab->freeHead;
+        slab->freeHead = index;
+
+        if (slab->numUsed-- == slab->capacity)
+            linkPartial(slab);
+
+        // Empty slabs can be reused for any size class.
+        if (!slab->numUsed) {
+            unlinkPartial(slab);
+            slab->capacity = 0u;
+            freeSlabs.push_back(slab);
+        }
+    }
+
+    void pushObject(uaddr vaddr) {
+        const auto arena = arenaFromVAddr(vaddr);
+        pushObject(arena, &arena->slabs[(vaddr - arena->base) / SLAB_SIZE], vaddr);
+    }
+
+    // Return the objects cached by a thread to their slabs, lock must be held.
+    void flushCache(ThreadCache& cache) {
+        for (auto& bin : cache.bins) {
+            for (auto i = 0u; i < bin.count; ++i)
+                pushObject(bin.objects[i]);
+
+            bin.count = bin.numZeroed = 0u;
+        }
+    }
+
+    void releaseThreadCache(std::thread::id thread) {
+        std::scoped_lock guard(lock);
+        const auto it = threadCaches.find(thread);
+        if (it != threadCaches.end()) {
+            flushCache(*it->second);
+            threadCaches.erase(it);
+        }
+    }
+
+    usize slabIndex(const Slab* slab) const {
+        if (!slab)
+            return HeapSnapshot::NO_SLAB;
+
+        const auto arena = arenaFromVAddr(slab->base);
+        const auto it = std::find_if(arenas.begin(), arenas.end(), [arena](const auto& a) { return a.get() == arena; });
+        return (it - arenas.begin()) * SLABS_PER_ARENA + (slab - arena->slabs.data());
+    }
+
+    Slab* slabFromIndex(usize index) const {
+        if (index == HeapSnapshot::NO_SLAB)
+            return nullptr;
+
+        return &arenas[index / SLABS_PER_ARENA]->slabs[index % SLABS_PER_ARENA];
+    }
+};
+
+// GuestHeap
+
+GuestHeap::GuestHeap(std::shared_ptr<memory::MemoryManager> mem) : m_Mem(mem) {
+    DASHLE_ASSERT(m_Mem);
+    m_Data = std::make_unique<Data>(m_Mem->maxMemory());
+
+    std::scoped_lock lock(Data::s_HeapsLock);
+    Data::s_Heaps.push_back(m_Data.get());
+}
+
+GuestHeap::~GuestHeap() {
+    {
+        std::scoped_lock lock(Data::s_HeapsLock);
+        std::erase(Data::s_Heaps, m_Data.get());
+    }
+
+    for (const auto& arena : m_Data->arenas)
+        DASHLE_ASSERT(m_Mem->free(arena->base));
+
+    for (const auto vaddr : m_Data->largeBlocks)
+        DASHLE_ASSERT(m_Mem->free(vaddr));
+}
+
+Expected<uaddr> GuestHeap::allocate(usize size, bool* zeroed) {
+    // Every call returns an unique address, like bionic does.
+    if (!size)
+        size = 1u;
+
+    if (size > MAX_SMALL_SIZE) {
+        DASHLE_TRY_EXPECTED_CONST(alignedSize, dashle::alignUp(size, MIN_ALIGNMENT));
+        if (alignedSize < size)
+            return Unexpected(Error::InvalidSize);
+
+        std::scoped_lock lock(m_Data->lock);
+        DASHLE_TRY_EXPECTED_CONST(block, m_Mem->allocate({
+            .size = alignedSize,
+            .alignment = MIN_ALIGNMENT,
+            .flags = memory::flags::PERM_READ_WRITE | memory::flags::LAZY_COMMIT,
+        }));
+
+        m_Data->largeBlocks.insert(block->virtualBase);
+        if (zeroed)
+            *zeroed = true;
+
+        return block->virtualBase;
+    }
+
+    const auto sizeClass = sizeClassIndex(size);
+    auto& bin = m_Data->threadCache().bins[sizeClass];
+    if (!bin.count) {
+        // Refill half the cache.
+        // Zeroed objects come last from a slab, only those after the last dirty one are tracked.
+        std::scoped_lock lock(m_Data->lock);
+        bool isZeroed = false;
+        DASHLE_TRY_EXPECTED(vaddr, m_Data->popObject(m_Mem.get(), sizeClass, isZeroed));
+        while (true) {
+            bin.objects[bin.count++] = vaddr;
+            bin.numZeroed = isZeroed ? bin.numZeroed + 1u : 0u;
+            if (bin.count == CACHE_SIZE / 2u)
+                break;
+
+            const auto next = m_Data->popObject(m_Mem.get(), sizeClass, isZeroed);
+            if (!next)
+                break;
+
+            vaddr = next.value();
+        }
+
+        // Hand out the lowest address first.
+        std::reverse(bin.objects.begin(), bin.objects.begin() + bin.count);
+    }
+
+    const auto vaddr = bin.objects[--bin.count];
+    if (zeroed)
+        *zeroed = bin.count < bin.numZeroed;
+
+    bin.numZeroed = std::min(bin.numZeroed, bin.count);
+    const auto arena = m_Data->arenaFromVAddr(vaddr);
+    arena->slabs[(vaddr - arena->base) / SLAB_SIZE].markAllocated(vaddr, true);
+    return vaddr;
+}
+
+Expected<uaddr> GuestHeap::allocateZeroed(usize count, usize size) {
+    usize totalSize = 0u;
+    if (__builtin_mul_overflow(count, size, &totalSize))
+        return Unexpected(Error::InvalidSize);
+
+    // Only reused memory has to be cleared.
+    bool zeroed = false;
+    DASHLE_TRY_EXPECTED_CONST(vaddr, allocate(totalSize, &zeroed));
+    if (!zeroed)
+        DASHLE_TRY_EXPECTED_VOID(m_Mem->fill(vaddr, 0u, totalSize));
+
+    return vaddr;
+}
+
+Expected<uaddr> GuestHeap::reallocate(uaddr vaddr, usize size) {
+    if (!vaddr)
+        return allocate(size);
+
+    if (!size) {
+        DASHLE_TRY_EXPECTED_VOID(free(vaddr));
+        return 0u;
+    }
+
+    // Keep the allocation if it fits and wouldn't waste too much space.
+    DASHLE_TRY_EXPECTED_CONST(oldSize, usableSize(vaddr));
+    if (size <= oldSize && size > oldSize / 2u)
+        return vaddr;
+
+    DASHLE_TRY_EXPECTED_CONST(newVAddr, allocate(size));
+    DASHLE_TRY_EXPECTED_VOID(m_Mem->copy(newVAddr, vaddr, std::min(size, oldSize)));
+    DASHLE_TRY_EXPECTED_VOID(free(vaddr));
+    return newVAddr;
+}
+
+Expected<void> GuestHeap::free(uaddr vaddr) {
+    if (!vaddr)
+        return EXPECTED_VOID;
+
+    const auto arena = m_Data->arenaFromVAddr(vaddr);
+    if (!arena) {
+        std::scoped_lock lock(m_Data->lock);
+        if (!m_Data->largeBlocks.erase(vaddr))
+            return Unexpected(Error::InvalidAddress);
+
+        return m_Mem->free(vaddr);
+    }
+
+    // Make sure this is an object that was handed out, and not freed already.
+    auto& slab = arena->slabs[(vaddr - arena->base) / SLAB_SIZE];
+    const auto sizeClass = slab.sizeClass.load(std::memory_order_relaxed);
+    if ((vaddr - slab.base) % CLASS_SIZES[sizeClass] || !slab.markAllocated(vaddr, false))
+        return Unexpected(Error::InvalidAddress);
+
+    auto& bin = m_Data->threadCache().bins[sizeClass];
+    if (bin.count == CACHE_SIZE) {
+        // Flush the older half of the cache.
+        std::scoped_lock lock(m_Data->lock);
+        for (auto i = 0u; i < CACHE_SIZE / 2u; ++i)
+            m_Data->pushObject(bin.objects[i]);
+
+        std::copy(bin.objects.begin() + CACHE_SIZE / 2u, bin.objects.end(), bin.objects.begin());
+        bin.count -= CACHE_SIZE / 2u;
+        bin.numZeroed -= std::min(bin.numZeroed, CACHE_SIZE / 2u);
+    }
+
+    bin.objects[bin.count++] = vaddr;
+    return EXPECTED_VOID;
+}
+
+Expected<usize> GuestHeap::usableSize(uaddr vaddr) const {
+    if (const auto arena = m_Data->arenaFromVAddr(vaddr)) {
+        const auto& slab = arena->slabs[(vaddr - arena->base) / SLAB_SIZE];
+        return CLASS_SIZES[slab.sizeClass.load(std::memory_order_relaxed)];
+    }
+
+    std::scoped_lock lock(m_Data->lock);
+    if (!m_Data->largeBlocks.contains(vaddr))
+        return Unexpected(Error::InvalidAddress);
+
+    DASHLE_TRY_EXPECTED_CONST(block, m_Mem->blockFromVAddr(vaddr));
+    return block.size;
+}
+
+std::shared_ptr<const HeapSnapshot> GuestHeap::snapshot() const {
+    std::scoped_lock lock(m_Data->lock);
+    auto snapshot = std::make_shared<HeapSnapshot>();
+
+    for (const auto& arena : m_Data->arenas) {
+        snapshot->arenas.push_back(arena->base);
+        for (const auto& slab : arena->slabs) {
+            snapshot->slabs.push_back({
+                .sizeClass = slab.sizeClass.load(std::memory_order_relaxed),
+                .capacity = slab.capacity,
+                .numUsed = slab.numUsed,
+                .numInitialized = slab.numInitialized,
+                .freeHead = slab.freeHead,
+                .dirtyEnd = slab.dirtyEnd,
+                .prev = m_Data->slabIndex(slab.prev),
+                .next = m_Data->slabIndex(slab.next),
+                .allocated = [&slab] {
+                    std::array<u64, ALLOCATED_WORDS> words;
+                    for (auto i = 0u; i < ALLOCATED_WORDS; ++i)
+                        words[i] = slab.allocated[i].load(std::memory_order_relaxed);
+
+                    return words;
+                }(),
+            });
+        }
+    }
+
+    for (const auto slab : m_Data->freeSlabs)
+        snapshot->freeSlabs.push_back(m_Data->slabIndex(slab));
+
+    for (auto i = 0u; i < NUM_CLASSES; ++i)
+        snapshot->partialSlabs[i] = m_Data->slabIndex(m_Data->partialSlabs[i]);
+
+    snapshot->largeBlocks.assign(m_Data->largeBlocks.begin(), m_Data->largeBlocks.end());
+
+    for (const auto& [id, cache] : m_Data->threadCaches) {
+        for (const auto& bin : cache->bins)
+            snapshot->cachedObjects.insert(snapshot->cachedObjects.end(), bin.objects.begin(), bin.objects.begin() + bin.count);
+    }
+
+    return snapshot;
+}
+
+Expected<void> GuestHeap::restore(const HeapSnapshot& snapshot) {
+    std::scoped_lock lock(m_Data->lock);
+
+    // Arenas must have been restored together with the memory.
+    std::vector<std::unique_ptr<Arena>> arenas;
+    for (const auto base : snapshot.arenas) {
+        DASHLE_TRY_EXPECTED_CONST(block, m_Mem->blockFromVAddr(base));
+        if (block.virtualBase != base || block.size != ARENA_SIZE)
+            return Unexpected(Error::InvalidOperation);
+
+        auto arena = std::make_unique<Arena>();
+        arena->base = base;
+        arena->hostBase = block.hostBase;
+        arenas.push_back(std::move(arena));
+    }
+
+    for (const auto& arena : m_Data->arenas)
+        m_Data->arenaTable[arena->base / ARENA_SIZE].store(nullptr, std::memory_order_relaxed);
+
+    m_Data->arenas = std::move(arenas);
+    for (const auto& arena : m_Data->arenas)
+        m_Data->arenaTable[arena->base / ARENA_SIZE].store(arena.get(), std::memory_order_release);
+
+    for (auto i = 0u; i < snapshot.slabs.size(); ++i) {
+        const auto& state = snapshot.slabs[i];
+        auto slab = m_Data->slabFromIndex(i);
+        slab->base = snapshot.arenas[i / SLABS_PER_ARENA] + (i % SLABS_PER_ARENA) * SLAB_SIZE;
+        slab->sizeClass.store(state.sizeClass, std::memory_order_relaxed);
+        slab->capacity = state.capacity;
+        slab->numUsed = state.numUsed;
+        slab->numInitialized = state.numInitialized;
+        slab->freeHead = state.freeHead;
+        slab->dirtyEnd = state.dirtyEnd;
+        slab->prev = m_Data->slabFromIndex(state.prev);
+        slab->next = m_Data->slabFromIndex(state.next);
+        for (auto j = 0u; j < ALLOCATED_WORDS; ++j)
+            slab->allocated[j].store(state.allocated[j], std::memory_order_relaxed);
+    }
+
+    m_Data->freeSlabs.clear();
+    for (const auto index : snapshot.freeSlabs)
+        m_Data->freeSlabs.push_back(m_Data->slabFromIndex(index));
+
+    for (auto i = 0u; i < NUM_CLASSES; ++i)
+        m_Data->partialSlabs[i] = m_Data->slabFromIndex(snapshot.partialSlabs[i]);
+
+    m_Data->largeBlocks.clear();
+    m_Data->largeBlocks.insert(snapshot.largeBlocks.begin(), snapshot.largeBlocks.end());
+
+    // Caches belong to threads which may not exist anymore, start over with empty ones.
+    for (auto& [id, cache] : m_Data->threadCaches) {
+        for (auto& bin : cache->bins)
+            bin.count = bin.numZeroed = 0u;
+    }
+
+    for (const auto vaddr : snapshot.cachedObjects)
+        m_Data->pushObject(vaddr);
+
+    return EXPECTED_VOID;
+}
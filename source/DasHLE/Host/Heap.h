@@ -0,0 +1,60 @@
+#ifndef _DASHLE_HOST_HEAP_H
+#define _DASHLE_HOST_HEAP_H
+
+#include "DasHLE/Host/Memory.h"
+
+#include <memory>
+
+namespace dashle::host::heap {
+
+constexpr static usize ARENA_SIZE = 0x200000;   // 2MB, memory is requested to the manager in arenas.
+constexpr static usize SLAB_SIZE = 0x10000;     // 64KB, arenas are split in slabs serving a single size class.
+constexpr static usize MAX_SMALL_SIZE = 0x1000; // 4KB, bigger allocations get their own block.
+constexpr static usize MIN_ALIGNMENT = 16u;     // Alignment of every allocation.
+
+// Heap state, see GuestHeap::snapshot.
+struct HeapSnapshot;
+
+// General purpose allocator for guest code (malloc & co.), layered on top of a MemoryManager.
+// Small allocations are served in O(1) from size class slabs through per thread caches, which only take
+// a lock to be refilled or flushed. Free objects are linked through the guest memory they occupy.
+class GuestHeap final {
+    struct Data;
+
+    std::shared_ptr<memory::MemoryManager> m_Mem;
+    std::unique_ptr<Data> m_Data;
+
+    // Also tell whether the memory was never handed out before, in which case it is still zeroed.
+    Expected<uaddr> allocate(usize size, bool* zeroed);
+
+public:
+    GuestHeap(std::shared_ptr<memory::MemoryManager> mem);
+    ~GuestHeap();
+
+    // Allocate memory, return the virtual address.
+    Expected<uaddr> allocate(usize size) { return allocate(size, nullptr); }
+
+    // Allocate zero initialized memory for count elements of the given size.
+    Expected<uaddr> allocateZeroed(usize count, usize size);
+
+    // Resize an allocation, moving it if required. Contents are preserved up to the smaller size.
+    Expected<uaddr> reallocate(uaddr vaddr, usize size);
+
+    // Free memory returned by this heap.
+    Expected<void> free(uaddr vaddr);
+
+    // Get the number of bytes that can be used from an allocation.
+    Expected<usize> usableSize(uaddr vaddr) const;
+
+    // Capture the host side state, to be paired with a snapshot of the guest memory taken at the same time.
+    // The heap must not be used by other threads meanwhile.
+    std::shared_ptr<const HeapSnapshot> snapshot() const;
+
+    // Go back to a captured state, after the paired memory snapshot has been restored.
+    // The heap must not be used by other threads meanwhile.
+    Expected<void> restore(const HeapSnapshot& snapshot);
+};
+
+} // namespace dashle::host::heap
+
+#endif /* _DASHLE_HOST_HEAP_H */
@@ -0,0 +1,521 @@
+#include "DasHLE/Support/Math.h"
+#include "DasHLE/Host/Memory.h"
+
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <csignal>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace dashle;
+using namespace dashle::host::memory;
+
+// Fault handling
+
+// Every live reservation is registered here, so that the fault handler can tell guest faults apart.
+struct Reservation {
+    std::atomic<uaddr> base = 0u;
+    std::atomic<usize> size = 0u;
+};
+
+constexpr static usize MAX_RESERVATIONS = 16u;
+static std::array<Reservation, MAX_RESERVATIONS> g_Reservations;
+static struct sigaction g_OldFaultAction;
+static bool g_FirstFaultHandler = false; // No handler was installed before this one.
+
+static void chainFault(int sig, siginfo_t* info, void* context) {
+    if (g_OldFaultAction.sa_flags & SA_SIGINFO) {
+        g_OldFaultAction.sa_sigaction(sig, info, context);
+        return;
+    }
+
+    if (g_OldFaultAction.sa_handler != SIG_DFL && g_OldFaultAction.sa_handler != SIG_IGN) {
+        g_OldFaultAction.sa_handler(sig);
+        return;
+    }
+
+    // Restore the default action, the faulting instruction will trigger it again.
+    signal(sig, SIG_DFL);
+}
+
+// Only uses async-signal-safe functions.
+static void writeFaultMessage(const char* message, uaddr value) {
+    constexpr char DIGITS[] = "0123456789ABCDEF";
+    std::array<char, 128u> buffer;
+    usize size = 0u;
+
+    for (auto c = message; *c && size < buffer.size() - 20u; ++c)
+        buffer[size++] = *c;
+
+    buffer[size++] = '0';
+    buffer[size++] = 'x';
+    for (auto shift = static_cast<int>(sizeof(uaddr) * 8u) - 4; shift >= 0; shift -= 4)
+        buffer[size++] = DIGITS[(value >> shift) & 0xFu];
+
+    buffer[size++] = '\n';
+    [[maybe_unused]] const auto written = write(STDERR_FILENO, buffer.data(), size);
+}
+
+static void onFault(int sig, siginfo_t* info, void* context) {
+    // Dynarmic's handler recovers faults coming from the Jit, and chains the others here. If it was installed
+    // before this one (e.g. as part of a shared library), Jit faults can't be told apart, so they all go to it.
+    if (!g_FirstFaultHandler) {
+        chainFault(sig, info, context);
+        return;
+    }
+
+    const auto addr = reinterpret_cast<uaddr>(info->si_addr);
+    for (const auto& reservation : g_Reservations) {
+        const auto base = reservation.base.load(std::memory_order_acquire);
+        if (base && addr >= base && (addr - base) < reservation.size.load(std::memory_order_acquire)) {
+            writeFaultMessage("Guest access violation, vaddr=", addr - base);
+            std::abort();
+        }
+    }
+
+    chainFault(sig, info, context);
+}
+
+// Installed before static constructors run, in particular before dynarmic's, which chains faults it doesn't handle.
+__attribute__((constructor(101))) static void installFaultHandler() {
+    struct sigaction action = {};
+    action.sa_sigaction = onFault;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    DASHLE_ASSERT(sigaction(SIGSEGV, &action, &g_OldFaultAction) == 0);
+    g_FirstFaultHandler = !(g_OldFaultAction.sa_flags & SA_SIGINFO) && g_OldFaultAction.sa_handler == SIG_DFL;
+}
+
+static bool registerReservation(uaddr base, usize size) {
+    for (auto& reservation : g_Reservations) {
+        // A zero size is never matched, so the handler can't see a partially registered reservation.
+        auto expected = static_cast<uaddr>(0u);
+        if (reservation.base.compare_exchange_strong(expected, base, std::memory_order_acq_rel)) {
+            reservation.size.store(size, std::memory_order_release);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void unregisterReservation(uaddr base) {
+    for (auto& reservation : g_Reservations) {
+        auto expected = base;
+        if (reservation.base.compare_exchange_strong(expected, 0u, std::memory_order_release))
+            return;
+    }
+
+    DASHLE_UNREACHABLE("Reservation not registered (base=0x{:X})", base);
+}
+
+constexpr static int hostProtection(usize flags) {
+    int prot = PROT_NONE;
+
+    // The Jit fetches code through the callbacks, so executable memory only has to be readable.
+    if (flags & (flags::PERM_READ | flags::PERM_EXEC))
+        prot |= PROT_READ;
+
+    if (flags & flags::PERM_WRITE)
+        prot |= PROT_READ | PROT_WRITE;
+
+    return prot;
+}
+
+// Range of the huge pages fully covered by a host range, empty if there are none.
+static std::pair<uaddr, uaddr> hugePageRange(uaddr start, uaddr end) {
+    DASHLE_ASSERT_WRAPPER_CONST(hugeStart, dashle::alignUp(start, HUGE_PAGE_SIZE));
+    DASHLE_ASSERT_WRAPPER_CONST(hugeEnd, dashle::alignDown(end, HUGE_PAGE_SIZE));
+    if (hugeStart < hugeEnd)
+        return { hugeStart, hugeEnd };
+
+    return { 0u, 0u };
+}
+
+// Call fn for the pages in [start, end) of a block, with the hugetlb mapping of the block (if any) in its own call.
+// Regular pages are not split, but hugetlb mappings can only be changed as a whole (EINVAL otherwise).
+template <typename Fn>
+static void forEachMapping(HugePages hugePages, const AllocatedBlock& block, uaddr start, uaddr end, Fn&& fn) {
+    if (start >= end)
+        return;
+
+    const auto [hugeStart, hugeEnd] = hugePages == HugePages::Explicit ?
+        hugePageRange(block.hostBase, block.hostBase + block.size) : std::pair<uaddr, uaddr>(0u, 0u);
+    if (hugeStart == hugeEnd) {
+        fn(start, end);
+        return;
+    }
+
+    DASHLE_ASSERT(start <= hugeStart && hugeEnd <= end);
+    if (start < hugeStart)
+        fn(start, hugeStart);
+
+    fn(hugeStart, hugeEnd);
+    if (hugeEnd < end)
+        fn(hugeEnd, end);
+}
+
+// MappedAllocator
+
+bool MappedAllocator::initialize(usize maxMemory) {
+    m_PageSize = static_cast<usize>(sysconf(_SC_PAGESIZE));
+    DASHLE_ASSERT(dashle::isPowerOfTwo(m_PageSize));
+    DASHLE_ASSERT_WRAPPER_CONST(size, dashle::alignUp(maxMemory, m_PageSize));
+
+    // Reserve the address space without committing anything, pages are made accessible on allocation.
+    // With huge pages the reservation must be aligned to them, so that aligned blocks map to aligned host memory.
+    const auto alignment = m_HugePages != HugePages::None ? HUGE_PAGE_SIZE : m_PageSize;
+    const auto reservation = mmap(nullptr, size + alignment - m_PageSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reservation == MAP_FAILED)
+        return false;
+
+    const auto reservationBase = reinterpret_cast<uaddr>(reservation);
+    DASHLE_ASSERT_WRAPPER_CONST(base, dashle::alignUp(reservationBase, alignment));
+    if (base != reservationBase)
+        munmap(reservation, base - reservationBase);
+
+    if (const auto tail = (reservationBase + size + alignment - m_PageSize) - (base + size))
+        munmap(reinterpret_cast<void*>(base + size), tail);
+
+    const auto addr = reinterpret_cast<void*>(base);
+
+    if (!registerReservation(reinterpret_cast<uaddr>(addr), size)) {
+        munmap(addr, size);
+        return false;
+    }
+
+    m_Base = reinterpret_cast<uaddr>(addr);
+    m_Size = size;
+    return true;
+}
+
+void MappedAllocator::finalize() {
+    if (m_Base) {
+        unregisterReservation(m_Base);
+        DASHLE_ASSERT(munmap(reinterpret_cast<void*>(m_Base), m_Size) == 0);
+        m_Base = 0u;
+        m_Size = 0u;
+    }
+}
+
+bool MappedAllocator::alloc(AllocatedBlock& block) {
+    DASHLE_ASSERT(m_Base);
+
+    if (block.virtualBase + block.size > m_Size)
+        return false;
+
+    // Blocks are not page aligned, so commit every page the block touches.
+    const auto hostBase = m_Base + block.virtualBase;
+    DASHLE_ASSERT_WRAPPER_CONST(pageStart, dashle::alignDown(hostBase, m_PageSize));
+    DASHLE_ASSERT_WRAPPER_CONST(pageEnd, dashle::alignUp(hostBase + block.size, m_PageSize));
+    if (mprotect(reinterpret_cast<void*>(pageStart), pageEnd - pageStart, PROT_READ | PROT_WRITE))
+        return false;
+
+    block.hostBase = hostBase;
+
+    if (m_HugePages != HugePages::None) {
+        const auto [hugeStart, hugeEnd] = hugePageRange(hostBase, hostBase + block.size);
+        if (hugeStart < hugeEnd) {
+            const auto addr = reinterpret_cast<void*>(hugeStart);
+            if (m_HugePages == HugePages::Transparent) {
+                adviseHugePages(hugeStart, hugeEnd - hugeStart);
+            } else {
+                // A failed fixed mapping could drop the range, so map the huge pages elsewhere and move them over.
+                // Regular pages stay in place if the pool can't satisfy the request.
+                const auto size = hugeEnd - hugeStart;
+                const auto huge = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (huge != MAP_FAILED && mremap(huge, size, size, MREMAP_MAYMOVE | MREMAP_FIXED, addr) == MAP_FAILED)
+                    munmap(huge, size);
+            }
+        }
+    }
+
+    if ((block.flags & flags::PERM_MASK) != flags::PERM_READ_WRITE)
+        protect(block);
+
+    return true;
+}
+
+void MappedAllocator::free(AllocatedBlock& block) {
+    DASHLE_ASSERT(m_Base);
+
+    // Only release the pages fully covered by the block, the others may be shared with neighbours.
+    // Mapping fresh pages (rather than discarding them) also drops pages backed by a restored image.
+    DASHLE_ASSERT_WRAPPER_CONST(pageStart, dashle::alignUp(block.hostBase, m_PageSize));
+    DASHLE_ASSERT_WRAPPER_CONST(pageEnd, dashle::alignDown(block.hostBase + block.size, m_PageSize));
+    forEachMapping(m_HugePages, block, pageStart, pageEnd, [](uaddr start, uaddr end) {
+        DASHLE_ASSERT(mmap(reinterpret_cast<void*>(start), end - start, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) != MAP_FAILED);
+    });
+
+    block.hostBase = 0u;
+}
+
+bool MappedAllocator::mapFile(AllocatedBlock& block, const HostFile& file) {
+    DASHLE_ASSERT(m_Base);
+
+    if (block.virtualBase + block.size > m_Size)
+        return false;
+
+    // Partial pages would be shared with neighbours.
+    const auto hostBase = m_Base + block.virtualBase;
+    if ((hostBase % m_PageSize) || (block.size % m_PageSize) || (file.offset % m_PageSize))
+        return false;
+
+    // A failed fixed mapping could drop the range, so map the file elsewhere and move it over.
+    const auto addr = mmap(nullptr, block.size, hostProtection(block.flags), file.shared ? MAP_SHARED : MAP_PRIVATE, file.fd, file.offset);
+    if (addr == MAP_FAILED)
+        return false;
+
+    if (mremap(addr, block.size, block.size, MREMAP_MAYMOVE | MREMAP_FIXED, reinterpret_cast<void*>(hostBase)) == MAP_FAILED) {
+        munmap(addr, block.size);
+        return false;
+    }
+
+    block.hostBase = hostBase;
+    return true;
+}
+
+void MappedAllocator::protect(const AllocatedBlock& block) {
+    DASHLE_ASSERT(m_Base);
+
+    // Pages shared with neighbours stay readable and writable.
+    DASHLE_ASSERT_WRAPPER_CONST(pageStart, dashle::alignUp(block.hostBase, m_PageSize));
+    DASHLE_ASSERT_WRAPPER_CONST(pageEnd, dashle::alignDown(block.hostBase + block.size, m_PageSize));
+    forEachMapping(m_HugePages, block, pageStart, pageEnd, [prot = hostProtection(block.flags)](uaddr start, uaddr end) {
+        DASHLE_ASSERT(mprotect(reinterpret_cast<void*>(start), end - start, prot) == 0);
+    });
+}
+
+usize MappedAllocator::hugePages() const {
+    if (m_Base)
+        return hostHugePages(m_Base, m_Size);
+
+    return 0u;
+}
+
+Optional<usize> MappedAllocator::residentMemory(const std::vector<const AllocatedBlock*>& blocks) const {
+    if (!m_Base)
+        return {};
+
+    // Only look at the pages of the blocks, a few at a time. Neighbours may share a page, count it once.
+    constexpr usize MAX_PAGES = 256u;
+    std::array<unsigned char, MAX_PAGES> pages;
+    usize resident = 0u;
+    uaddr counted = 0u;
+    for (const auto block : blocks) {
+        DASHLE_ASSERT_WRAPPER_CONST(blockStart, dashle::alignDown(block->hostBase, m_PageSize));
+        DASHLE_ASSERT_WRAPPER_CONST(pageEnd, dashle::alignUp(block->hostBase + block->size, m_PageSize));
+        auto pageStart = std::max(blockStart, counted);
+        while (pageStart < pageEnd) {
+            const auto numPages = std::min((pageEnd - pageStart) / m_PageSize, MAX_PAGES);
+            if (mincore(reinterpret_cast<void*>(pageStart), numPages * m_PageSize, pages.data()))
+                return {};
+
+            resident += std::count_if(pages.begin(), pages.begin() + numPages, [](unsigned char page) { return page & 1u; }) * m_PageSize;
+            pageStart += numPages * m_PageSize;
+        }
+
+        counted = std::max(counted, pageEnd);
+    }
+
+    return resident;
+}
+
+// Snapshots
+
+struct MappedImage : HostImage {
+    int fd;
+    usize size;
+
+    MappedImage(int fd, usize size) : fd(fd), size(size) {}
+    ~MappedImage() { close(fd); }
+};
+
+// Write the non zero pages in [start, end) at the same offsets, leaving holes for the others.
+static bool writePages(int fd, uaddr base, uaddr start, uaddr end, usize pageSize) {
+    while (start < end) {
+        const auto isZero = [pageSize](uaddr page) {
+            const auto words = reinterpret_cast<const u64*>(page);
+            return std::all_of(words, words + pageSize / sizeof(u64), [](u64 word) { return !word; });
+        };
+
+        if (isZero(start)) {
+            start += pageSize;
+            continue;
+        }
+
+        auto runEnd = start + pageSize;
+        while (runEnd < end && !isZero(runEnd))
+            runEnd += pageSize;
+
+        while (start < runEnd) {
+            const auto written = pwrite(fd, reinterpret_cast<const void*>(start), runEnd - start, start - base);
+            if (written <= 0)
+                return false;
+
+            start += written;
+        }
+    }
+
+    return true;
+}
+
+std::shared_ptr<const HostImage> MappedAllocator::capture(const std::vector<const AllocatedBlock*>& blocks) {
+    DASHLE_ASSERT(m_Base);
+
+    const auto fd = memfd_create("DasHLE-image", MFD_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+
+    auto image = std::make_shared<MappedImage>(fd, m_Size);
+    if (ftruncate(fd, m_Size))
+        return nullptr;
+
+    for (const auto block : blocks) {
+        DASHLE_ASSERT_WRAPPER_CONST(pageStart, dashle::alignDown(block->hostBase, m_PageSize));
+        DASHLE_ASSERT_WRAPPER_CONST(pageEnd, dashle::alignUp(block->hostBase + block->size, m_PageSize));
+
+        // Blocks which are not readable must be temporarily made so.
+        const auto readable = hostProtection(block->flags) & PROT_READ;
+        if (!readable) {
+            AllocatedBlock copy = *block;
+            copy.flags = flags::PERM_READ;
+            protect(copy);
+        }
+
+        const auto written = writePages(fd, m_Base, pageStart, pageEnd, m_PageSize);
+
+        if (!readable)
+            protect(*block);
+
+        if (!written)
+            return nullptr;
+    }
+
+    return image;
+}
+
+bool MappedAllocator::restore(const HostImage& image, const std::vector<const AllocatedBlock*>&, std::vector<AllocatedBlock>& blocks) {
+    DASHLE_ASSERT(m_Base);
+
+    const auto mappedImage = dynamic_cast<const MappedImage*>(&image);
+    if (!mappedImage || mappedImage->size != m_Size)
+        return false;
+
+    // A single mapping replaces the current blocks, pages are shared with the image until written.
+    if (mmap(reinterpret_cast<void*>(m_Base), m_Size, PROT_NONE, MAP_PRIVATE | MAP_FIXED | MAP_NORESERVE, mappedImage->fd, 0) == MAP_FAILED)
+        return false;
+
+    // Make the pages touched by the blocks accessible, merging adjacent ranges.
+    uaddr rangeStart = 0u;
+    uaddr rangeEnd = 0u;
+    const auto commitRange = [&rangeStart, &rangeEnd] {
+        if (rangeStart < rangeEnd)
+            return mprotect(reinterpret_cast<void*>(rangeStart), rangeEnd - rangeStart, PROT_READ | PROT_WRITE) == 0;
+
+        return true;
+    };
+
+    for (auto& block : blocks) {
+        block.hostBase = m_Base + block.virtualBase;
+        DASHLE_ASSERT_WRAPPER_CONST(pageStart, dashle::alignDown(block.hostBase, m_PageSize));
+        DASHLE_ASSERT_WRAPPER_CONST(pageEnd, dashle::alignUp(block.hostBase + block.size, m_PageSize));
+        if (pageStart > rangeEnd) {
+            if (!commitRange())
+                return false;
+
+            rangeStart = pageStart;
+        }
+
+        rangeEnd = pageEnd;
+    }
+
+    if (!commitRange())
+        return false;
+
+    for (const auto& block : blocks) {
+        if ((block.flags & flags::PERM_MASK) != flags::PERM_READ_WRITE)
+            protect(block);
+    }
+
+    return true;
+}
+
+// Host mappings
+
+usize dashle::host::memory::hostPageSize() {
+    return static_cast<usize>(sysconf(_SC_PAGESIZE));
+}
+
+Optional<u64> dashle::host::memory::hostFileSize(int fd) {
+    struct stat info;
+    if (fstat(fd, &info) || info.st_size < 0)
+        return {};
+
+    return static_cast<u64>(info.st_size);
+}
+
+std::vector<std::pair<uaddr, usize>> dashle::host::memory::hostMappings(usize perms) {
+    std::vector<std::pair<uaddr, usize>> mappings;
+    std::ifstream maps("/proc/self/maps");
+    std::string line;
+    while (std::getline(maps, line)) {
+        unsigned long start = 0u;
+        unsigned long end = 0u;
+        char permString[5] = {};
+        if (std::sscanf(line.c_str(), "%lx-%lx %4s", &start, &end, permString) != 3)
+            continue;
+
+        usize mappingPerms = 0u;
+        if (permString[0] == 'r')
+            mappingPerms |= flags::PERM_READ;
+
+        if (permString[1] == 'w')
+            mappingPerms |= flags::PERM_WRITE;
+
+        if (permString[2] == 'x')
+            mappingPerms |= flags::PERM_EXEC;
+
+        if ((mappingPerms & perms) == perms)
+            mappings.emplace_back(start, end - start);
+    }
+
+    return mappings;
+}
+
+bool dashle::host::memory::adviseHugePages(uaddr addr, usize size) {
+    return madvise(reinterpret_cast<void*>(addr), size, MADV_HUGEPAGE) == 0;
+}
+
+usize dashle::host::memory::hostHugePages(uaddr addr, usize size) {
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool overlaps = false;
+    usize hugeKB = 0u;
+    while (std::getline(smaps, line)) {
+        unsigned long start = 0u;
+        unsigned long end = 0u;
+        if (std::sscanf(line.c_str(), "%lx-%lx", &start, &end) == 2) {
+            overlaps = start < addr + size && addr < end;
+            continue;
+        }
+
+        if (!overlaps)
+            continue;
+
+        // Counters of a mapping are in kB.
+        unsigned long kb = 0u;
+        if (std::sscanf(line.c_str(), "AnonHugePages: %lu kB", &kb) == 1 ||
+            std::sscanf(line.c_str(), "Private_Hugetlb: %lu kB", &kb) == 1 ||
+            std::sscanf(line.c_str(), "Shared_Hugetlb: %lu kB", &kb) == 1)
+            hugeKB += kb;
+    }
+
+    return hugeKB * 1024u / HUGE_PAGE_SIZE;
+}
@@ -0,0 +1,17 @@
+#include "DasHLE/Host/Sync.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace dashle;
+
+// Guest memory is never shared with other processes, so private futexes are enough.
+
+void dashle::host::sync::futexWait(u32& word, u32 expected) {
+    syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void dashle::host::sync::futexWake(u32& word, u32 count) {
+    syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
@@ -1,10 +1,15 @@
 #include "DasHLE/Support/Math.h"
+#include "DasHLE/Support/ChunkedSet.h"
+#include "DasHLE/Support/Epoch.h"
 #include "DasHLE/Host/Memory.h"
 
-#include <set>
+#include <deque>
+#include <mutex>
+#include <span>
 #include <algorithm>
 #include <iterator>
 #include <cstdlib>
+#include <cstring>
 
 using namespace dashle;
 using namespace dashle::host::memory;
@@ -12,7 +17,8 @@ using namespace dashle::host::memory;
 // HostAllocator
 
 bool HostAllocator::alloc(AllocatedBlock& block) {
-    if (auto addr = std::malloc(block.size)) {
+    // Big zeroed allocations come straight from the system, and are only committed when touched.
+    if (auto addr = (block.flags & flags::LAZY_COMMIT) ? std::calloc(1u, block.size) : std::malloc(block.size)) {
         block.hostBase = reinterpret_cast<uaddr>(addr);
         return true;
     }
@@ -25,33 +31,52 @@ void HostAllocator::free(AllocatedBlock& block) {
     block.hostBase = 0u;
 }
 
-// MemoryManager
-
-struct FreeBlock {
-    uaddr virtualBase = 0u;
-    usize size = 0u;
+// Plain copy of every block.
+struct BufferImage : HostImage {
+    std::vector<std::vector<u8>> contents;
 };
 
-struct AllocatedBlockComparator {
-    bool operator()(const AllocatedBlock& a, const AllocatedBlock& b) const {
-        // When size = 0 we're comparing the block with a virtual address.
+std::shared_ptr<const HostImage> HostAllocator::capture(const std::vector<const AllocatedBlock*>& blocks) {
+    auto image = std::make_shared<BufferImage>();
+    image->contents.reserve(blocks.size());
+    for (const auto block : blocks) {
+        const auto data = reinterpret_cast<const u8*>(block->hostBase);
+        image->contents.emplace_back(data, data + block->size);
+    }
 
-        if (!a.size) {
-            // A is the virtual address. Comp(A, B) returns true if A < B.
-            // Hence comp(A, B) = vaddr < block.base.
-            return a.virtualBase < b.virtualBase;
-        }
+    return image;
+}
+
+bool HostAllocator::restore(const HostImage& image, const std::vector<const AllocatedBlock*>& current, std::vector<AllocatedBlock>& blocks) {
+    const auto bufferImage = dynamic_cast<const BufferImage*>(&image);
+    if (!bufferImage || bufferImage->contents.size() != blocks.size())
+        return false;
 
-        if (!b.size) {
-            // B is the virtual address. Comp(A, B) returns true if A < B.
-            // Hence comp(A, B) = (block.base + block.size) <= vaddr.
-            return (a.virtualBase + a.size) <= b.virtualBase;
+    // Blocks are not tied to their address, so the current ones can be kept until the others are ready.
+    for (auto i = 0u; i < blocks.size(); ++i) {
+        if (!alloc(blocks[i])) {
+            for (auto j = 0u; j < i; ++j)
+                free(blocks[j]);
+
+            return false;
         }
 
-        // Generic case: both A and B are blocks.
-        // We know they can't overlap, hence comp(A, B) = A.base < B.base.
-        return a.virtualBase < b.virtualBase;
+        std::copy(bufferImage->contents[i].begin(), bufferImage->contents[i].end(), reinterpret_cast<u8*>(blocks[i].hostBase));
+    }
+
+    for (const auto block : current) {
+        auto copy = *block;
+        free(copy);
     }
+
+    return true;
+}
+
+// MemoryManager
+
+struct FreeBlock {
+    uaddr virtualBase = 0u;
+    usize size = 0u;
 };
 
 struct FreeBlockComparator {
@@ -64,54 +89,366 @@ struct FreeBlockComparator {
     };
 };
 
-using AllocatedBlockSet = std::set<AllocatedBlock, AllocatedBlockComparator>;
-using FreeBlockSet = std::set<FreeBlock, FreeBlockComparator>;
+struct FreeBlockAddrComparator {
+    constexpr bool operator()(const FreeBlock& a, const FreeBlock& b) const {
+        // Free blocks never overlap, so the base is enough.
+        return a.virtualBase < b.virtualBase;
+    };
+};
+
+using FreeBlockSet = ChunkedSet<FreeBlock, FreeBlockComparator>;
+using FreeBlockAddrSet = ChunkedSet<FreeBlock, FreeBlockAddrComparator>;
+
+// Allocated blocks index, read without locks.
+// This is a copy-on-write B+tree: published nodes and the blocks they reference are never modified. Writers copy
+// the nodes along the path to the change, publish the new root and retire whatever got replaced.
+struct BlockNode {
+    constexpr static usize CAPACITY = 64u;
+
+    bool leaf = true;
+    usize size = 0u;
+    std::array<uaddr, CAPACITY> keys;       // Block bases, or the smallest base of each child.
+    std::array<const void*, CAPACITY> ptrs; // Blocks for leaves, children otherwise.
+
+    const BlockNode* child(usize index) const { return static_cast<const BlockNode*>(ptrs[index]); }
+    const AllocatedBlock* block(usize index) const { return static_cast<const AllocatedBlock*>(ptrs[index]); }
+
+    // Index of the highest key not greater than vaddr.
+    Optional<usize> floorIndex(uaddr vaddr) const {
+        const auto it = std::upper_bound(keys.begin(), keys.begin() + size, vaddr);
+        if (it == keys.begin())
+            return {};
+
+        return (it - keys.begin()) - 1u;
+    }
+
+    void insertAt(usize index, uaddr key, const void* ptr) {
+        std::copy_backward(keys.begin() + index, keys.begin() + size, keys.begin() + size + 1u);
+        std::copy_backward(ptrs.begin() + index, ptrs.begin() + size, ptrs.begin() + size + 1u);
+        keys[index] = key;
+        ptrs[index] = ptr;
+        ++size;
+    }
+
+    void eraseAt(usize index) {
+        std::copy(keys.begin() + index + 1u, keys.begin() + size, keys.begin() + index);
+        std::copy(ptrs.begin() + index + 1u, ptrs.begin() + size, ptrs.begin() + index);
+        --size;
+    }
+};
+
+// Find the block with the highest base not greater than vaddr.
+static const AllocatedBlock* blockTreeFloor(const BlockNode* node, uaddr vaddr) {
+    while (true) {
+        const auto index = node->floorIndex(vaddr);
+        if (!index)
+            return nullptr;
+
+        if (node->leaf)
+            return node->block(*index);
+
+        node = node->child(*index);
+    }
+}
+
+// Build a tree from blocks sorted by address, leaving room in each node for later insertions.
+static const BlockNode* buildBlockTree(const std::vector<const AllocatedBlock*>& blocks) {
+    constexpr auto FILL = BlockNode::CAPACITY * 3u / 4u;
+
+    std::vector<BlockNode*> level;
+    for (auto i = 0u; i < blocks.size(); ++i) {
+        if (!(i % FILL))
+            level.push_back(new BlockNode);
+
+        level.back()->insertAt(level.back()->size, blocks[i]->virtualBase, blocks[i]);
+    }
+
+    if (level.empty())
+        return new BlockNode;
+
+    while (level.size() > 1u) {
+        std::vector<BlockNode*> parents;
+        for (auto i = 0u; i < level.size(); ++i) {
+            if (!(i % FILL)) {
+                parents.push_back(new BlockNode);
+                parents.back()->leaf = false;
+            }
+
+            parents.back()->insertAt(parents.back()->size, level[i]->keys[0], level[i]);
+        }
+
+        level = std::move(parents);
+    }
+
+    return level.front();
+}
+
+// Children are visited before their parent.
+template <typename Fn>
+static void visitBlockTree(const BlockNode* node, Fn fn) {
+    if (!node->leaf) {
+        for (auto i = 0u; i < node->size; ++i)
+            visitBlockTree(node->child(i), fn);
+    }
+
+    fn(node);
+}
+
+struct dashle::host::memory::MemorySnapshot {
+    usize maxMemory;
+    std::vector<AllocatedBlock> blocks; // Sorted by address, host bases are not meaningful.
+    std::shared_ptr<const HostImage> image;
+};
 
 struct dashle::host::memory::MemoryManager::Data {
-    AllocatedBlockSet allocatedBlocks;
+    std::mutex lock; // Held by writers.
+    std::atomic<const BlockNode*> blockTree = new BlockNode;
+    std::vector<const BlockNode*> replacedNodes; // Retired once the new tree is published.
+    EpochReclaimer reclaimer;
+    std::deque<AllocatedBlock> blockPool;
+    std::vector<AllocatedBlock*> unusedBlocks;
+    // Free blocks are indexed both by size (for best-fit) and by address (for hints and merging).
     FreeBlockSet freeBlocks;
+    FreeBlockAddrSet freeBlocksByAddr;
+
+    ~Data() {
+        reclaimer.synchronize();
+        visitBlockTree(currentTree(), [](const BlockNode* node) { delete node; });
+    }
+
+    const BlockNode* currentTree() const { return blockTree.load(std::memory_order_relaxed); }
+
+    // Published blocks, sorted by address.
+    std::vector<const AllocatedBlock*> allocatedBlocks() const {
+        std::vector<const AllocatedBlock*> blocks;
+        visitBlockTree(currentTree(), [&blocks](const BlockNode* node) {
+            if (node->leaf) {
+                for (auto i = 0u; i < node->size; ++i)
+                    blocks.push_back(node->block(i));
+            }
+        });
+        return blocks;
+    }
+
+    BlockNode* copyNode(const BlockNode* node) {
+        replacedNodes.push_back(node);
+        return new BlockNode(*node);
+    }
+
+    void publishTree(const BlockNode* root) {
+        blockTree.store(root, std::memory_order_seq_cst);
+        reclaimer.retire([nodes = std::move(replacedNodes)] {
+            for (const auto node : nodes)
+                delete node;
+        });
+        replacedNodes.clear();
+    }
+
+    // Insert into a copied node, return the upper half if it had to be split.
+    BlockNode* treeInsert(BlockNode* node, uaddr key, const AllocatedBlock* block) {
+        if (node->leaf) {
+            const auto index = node->floorIndex(key);
+            node->insertAt(index ? *index + 1u : 0u, key, block);
+        } else {
+            const auto index = node->floorIndex(key).value_or(0u);
+            const auto child = copyNode(node->child(index));
+            node->ptrs[index] = child;
+            if (const auto sibling = treeInsert(child, key, block))
+                node->insertAt(index + 1u, sibling->keys[0], sibling);
+
+            node->keys[index] = child->keys[0];
+        }
+
+        if (node->size < BlockNode::CAPACITY)
+            return nullptr;
+
+        constexpr auto HALF = BlockNode::CAPACITY / 2u;
+        auto sibling = new BlockNode;
+        sibling->leaf = node->leaf;
+        sibling->size = node->size - HALF;
+        std::copy(node->keys.begin() + HALF, node->keys.end(), sibling->keys.begin());
+        std::copy(node->ptrs.begin() + HALF, node->ptrs.end(), sibling->ptrs.begin());
+        node->size = HALF;
+        return sibling;
+    }
+
+    // Erase from a copied node, return false if it became empty.
+    bool treeErase(BlockNode* node, uaddr key) {
+        DASHLE_ASSERT_WRAPPER_CONST(index, node->floorIndex(key));
+        if (node->leaf) {
+            DASHLE_ASSERT(node->keys[index] == key);
+            node->eraseAt(index);
+        } else {
+            const auto child = copyNode(node->child(index));
+            if (treeErase(child, key)) {
+                node->keys[index] = child->keys[0];
+                node->ptrs[index] = child;
+            } else {
+                delete child;
+                node->eraseAt(index);
+            }
+        }
+
+        return node->size;
+    }
+
+    void treeReplace(BlockNode* node, uaddr key, const AllocatedBlock* block) {
+        DASHLE_ASSERT_WRAPPER_CONST(index, node->floorIndex(key));
+        if (node->leaf) {
+            DASHLE_ASSERT(node->keys[index] == key);
+            node->ptrs[index] = block;
+        } else {
+            const auto child = copyNode(node->child(index));
+            node->ptrs[index] = child;
+            treeReplace(child, key, block);
+        }
+    }
+
+    const AllocatedBlock* findAllocatedBlock(uaddr vbase) const {
+        const auto block = blockTreeFloor(currentTree(), vbase);
+        if (block && block->virtualBase == vbase)
+            return block;
+
+        return nullptr;
+    }
+
+    AllocatedBlock* newAllocatedBlock(const AllocatedBlock& block) {
+        AllocatedBlock* slot = nullptr;
+        if (unusedBlocks.empty()) {
+            slot = &blockPool.emplace_back();
+        } else {
+            slot = unusedBlocks.back();
+            unusedBlocks.pop_back();
+        }
+
+        *slot = block;
+        return slot;
+    }
+
+    // Slots are reused only once no reader can be looking at them.
+    void retireAllocatedBlock(const AllocatedBlock* block) {
+        reclaimer.retire([this, block] { unusedBlocks.push_back(const_cast<AllocatedBlock*>(block)); });
+    }
+
+    const AllocatedBlock* insertAllocatedBlock(const AllocatedBlock& block) {
+        const auto slot = newAllocatedBlock(block);
+        auto root = copyNode(currentTree());
+        if (const auto sibling = treeInsert(root, slot->virtualBase, slot)) {
+            const auto newRoot = new BlockNode;
+            newRoot->leaf = false;
+            newRoot->insertAt(0u, root->keys[0], root);
+            newRoot->insertAt(1u, sibling->keys[0], sibling);
+            root = newRoot;
+        }
+
+        publishTree(root);
+        return slot;
+    }
+
+    // Publish a copy of the block with the new flags.
+    const AllocatedBlock* replaceAllocatedBlock(const AllocatedBlock* block, usize flags) {
+        const auto slot = newAllocatedBlock(*block);
+        slot->flags = flags;
+        const auto root = copyNode(currentTree());
+        treeReplace(root, slot->virtualBase, slot);
+        publishTree(root);
+        retireAllocatedBlock(block);
+        return slot;
+    }
+
+    void eraseAllocatedBlock(const AllocatedBlock* block) {
+        auto root = copyNode(currentTree());
+        if (!treeErase(root, block->virtualBase))
+            root->leaf = true;
+
+        // Drop roots with a single child.
+        while (!root->leaf && root->size == 1u) {
+            const auto child = const_cast<BlockNode*>(root->child(0u));
+            delete root;
+            root = child;
+        }
+
+        publishTree(root);
+        retireAllocatedBlock(block);
+    }
+
+    void insertFreeBlock(const FreeBlock& block) {
+        DASHLE_ASSERT(freeBlocks.insert(block));
+        DASHLE_ASSERT(freeBlocksByAddr.insert(block));
+    }
+
+    void eraseFreeBlock(const FreeBlock& block) {
+        DASHLE_ASSERT(freeBlocks.erase(block) == 1u);
+        DASHLE_ASSERT(freeBlocksByAddr.erase(block) == 1u);
+    }
+
+    // Find the free block containing vaddr (end included).
+    FreeBlockSet::iterator freeBlockFromVAddr(uaddr vaddr) {
+        auto it = freeBlocksByAddr.upper_bound(FreeBlock{ .virtualBase = vaddr });
+        if (it == freeBlocksByAddr.begin())
+            return freeBlocks.end();
+
+        --it;
+        if (vaddr > (it->virtualBase + it->size))
+            return freeBlocks.end();
+
+        return freeBlocks.find(*it);
+    }
 };
 
 void MemoryManager::initialize() {
     // Initialize allocator.
     DASHLE_ASSERT(m_HostAllocator);
-    DASHLE_ASSERT(m_HostAllocator->initialize());
+    DASHLE_ASSERT(m_HostAllocator->initialize(maxMemory()));
 
     // Add main free block.
-    const auto pair = m_Data->freeBlocks.insert({
+    m_Data->insertFreeBlock({
         .virtualBase = 0u,
         .size = maxMemory()
     });
-    DASHLE_ASSERT(pair.second);
 }
 
 void MemoryManager::finalize() {
     DASHLE_ASSERT(m_Data);
 
+    // Remove all allocated blocks.
+    std::vector<const AllocatedBlock*> blocks;
+    visitBlockTree(m_Data->currentTree(), [this, &blocks](const BlockNode* node) {
+        m_Data->replacedNodes.push_back(node);
+        if (node->leaf) {
+            for (auto i = 0u; i < node->size; ++i)
+                blocks.push_back(node->block(i));
+        }
+    });
+
+    m_Data->publishTree(new BlockNode);
+
     // Free all allocated memory.
-    auto& allocatedBlocks = m_Data->allocatedBlocks;
-    auto it = allocatedBlocks.begin();
-    while (it != allocatedBlocks.end()) {
-        auto node = allocatedBlocks.extract(it);
-        m_HostAllocator->free(node.value());
-        it = allocatedBlocks.begin();
+    for (const auto block : blocks) {
+        auto hostBlock = *block;
+        hostFree(hostBlock);
+        m_Data->retireAllocatedBlock(block);
     }
 
-    // Remove memory blocks.
+    m_UsedMemory = 0u;
+
+    // The allocator may release the whole space, wait for readers to be done with it.
+    m_Data->reclaimer.synchronize();
     m_Data->freeBlocks.clear();
+    m_Data->freeBlocksByAddr.clear();
 
     // Finalize allocator.
     m_HostAllocator->finalize();
 }
 
-bool MemoryManager::hostAlloc(AllocatedBlock& block) {
+bool MemoryManager::hostAlloc(AllocatedBlock& block, const HostFile* file) {
     DASHLE_ASSERT(m_HostAllocator);
 
     const auto originalVBase = block.virtualBase;
     const auto originalSize = block.size;
     const auto originalFlags = block.flags;
 
-    bool ret = m_HostAllocator->alloc(block);
+    bool ret = file ? m_HostAllocator->mapFile(block, *file) : m_HostAllocator->alloc(block);
 
     // Allocators shall not modify block values.
     DASHLE_ASSERT(block.virtualBase == originalVBase);
@@ -135,16 +472,17 @@ MemoryManager::MemoryManager(std::unique_ptr<HostAllocator> allocator, usize siz
 MemoryManager::~MemoryManager() { finalize(); }
 
 void MemoryManager::reset() {
+    std::scoped_lock lock(m_Data->lock);
     finalize();
     initialize();
+    ++m_Generation;
 }
 
-Expected<const AllocatedBlock*> MemoryManager::blockFromVAddr(uaddr vaddr) const {
-    const auto& allocatedBlocks = m_Data->allocatedBlocks;
-    const auto it = allocatedBlocks.find({ .virtualBase = vaddr });
-
-    if (it != allocatedBlocks.end())
-        return &*it;
+Expected<AllocatedBlock> MemoryManager::blockFromVAddr(uaddr vaddr) const {
+    EpochGuard guard;
+    const auto block = blockTreeFloor(m_Data->blockTree.load(std::memory_order_seq_cst), vaddr);
+    if (block && vaddr < (block->virtualBase + block->size))
+        return *block;
 
     return Unexpected(Error::NotFound);
 }
@@ -164,7 +502,7 @@ static Expected<uaddr> alignedBase(uaddr base, usize alignment) {
 static Expected<FreeBlockSet::iterator> findFreeBlock(FreeBlockSet& freeBlocks, usize requestedSize, usize alignment) {
     // Find the smallest block that can hold size bytes (best-fit).
     // This is optimized for small allocations.
-    auto it = freeBlocks.lower_bound({.size = requestedSize});
+    auto it = freeBlocks.lower_bound(FreeBlock{ .size = requestedSize });
     if (it == freeBlocks.end())
         return Unexpected(Error::NoVirtualMemory);
 
@@ -184,7 +522,13 @@ static Expected<FreeBlockSet::iterator> findFreeBlock(FreeBlockSet& freeBlocks,
     return it;
 }
 
+usize MemoryManager::numFreeBlocks() const {
+    std::scoped_lock lock(m_Data->lock);
+    return m_Data->freeBlocks.size();
+}
+
 Expected<uaddr> MemoryManager::findFreeAddr(usize size, usize alignment) const {
+    std::scoped_lock lock(m_Data->lock);
     return findFreeBlock(m_Data->freeBlocks, size, alignment).and_then([alignment](FreeBlockSet::iterator it) -> Expected<uaddr> {
         if (alignment) {
             // If we got there, the alignment has to be valid.
@@ -196,7 +540,7 @@ Expected<uaddr> MemoryManager::findFreeAddr(usize size, usize alignment) const {
     });
 }
 
-Expected<const AllocatedBlock*> MemoryManager::allocate(const AllocArgs& args) {
+Expected<const AllocatedBlock*> MemoryManager::allocate(const AllocArgs& args, const HostFile* file) {
     auto alignment = args.alignment;
 
     if (!args.size)
@@ -226,7 +570,7 @@ Expected<const AllocatedBlock*> MemoryManager::allocate(const AllocArgs& args) {
         alignment = 0;
     }
 
-    auto& allocatedBlocks = m_Data->allocatedBlocks;
+    std::scoped_lock lock(m_Data->lock);
     auto& freeBlocks = m_Data->freeBlocks;
     auto allocIt = freeBlocks.end();
     uaddr allocBase = 0u;
@@ -235,15 +579,9 @@ Expected<const AllocatedBlock*> MemoryManager::allocate(const AllocArgs& args) {
     if (args.hint) {
         DASHLE_ASSERT_WRAPPER(hint, args.hint);
 
-        // Find a block that contains our hint (slow!).
-        auto it = freeBlocks.begin();
-        while (it != freeBlocks.end()) {
-            if (hint >= it->virtualBase && hint <= (it->virtualBase + it->size))
-                break;
+        // Find a block that contains our hint.
+        auto it = m_Data->freeBlockFromVAddr(hint);
 
-            ++it;
-        }
-    
         // Handle alignment and make sure that we have enough space.
         if (it != freeBlocks.end()) {
             // Alignment checks also check for available space.
@@ -271,6 +609,10 @@ Expected<const AllocatedBlock*> MemoryManager::allocate(const AllocArgs& args) {
                     }
                 }
             }
+
+            // The free block may still be too small.
+            if (it != freeBlocks.end() && (it->virtualBase + it->size) - hint < args.size)
+                it = freeBlocks.end();
         }
 
         // Fail if we havent found an address and the hint was enforced.
@@ -299,18 +641,17 @@ Expected<const AllocatedBlock*> MemoryManager::allocate(const AllocArgs& args) {
     DASHLE_ASSERT(allocIt != freeBlocks.end());
 
     // Allocate block in memory.
-    auto freeBlockNode = freeBlocks.extract(allocIt);
-    auto& freeBlock = freeBlockNode.value();
+    const auto freeBlock = *allocIt;
     auto allocatedBlock = AllocatedBlock {
         .virtualBase = allocBase,
         .size = args.size,
-        .flags = args.flags & flags::PERM_MASK
+        .flags = args.flags & flags::BLOCK_MASK
     };
 
-    if (!hostAlloc(allocatedBlock)) {
-        freeBlocks.insert(std::move(freeBlockNode));
+    if (!hostAlloc(allocatedBlock, file))
         return Unexpected(Error::NoHostMemory);
-    }
+
+    m_Data->eraseFreeBlock(freeBlock);
 
     // Split free block.
     auto freeBlockFirst = FreeBlock {
@@ -318,114 +659,278 @@ Expected<const AllocatedBlock*> MemoryManager::allocate(const AllocArgs& args) {
         .size = allocatedBlock.virtualBase - freeBlock.virtualBase
     };
     if (freeBlockFirst.size)
-        freeBlocks.insert(std::move(freeBlockFirst));
+        m_Data->insertFreeBlock(freeBlockFirst);
 
     auto freeBlockLast = FreeBlock {
         .virtualBase = allocatedBlock.virtualBase + allocatedBlock.size,
         .size = (freeBlock.virtualBase + freeBlock.size) - (allocatedBlock.virtualBase + allocatedBlock.size)
     };
     if (freeBlockLast.size)
-        freeBlocks.insert(std::move(freeBlockLast));
+        m_Data->insertFreeBlock(freeBlockLast);
 
     // Add the new allocated block.
-    auto ret = allocatedBlocks.insert(allocatedBlock);
-    DASHLE_ASSERT(ret.second);
-    m_UsedMemory += allocatedBlock.size;
-    return &*ret.first;
+    const auto block = m_Data->insertAllocatedBlock(allocatedBlock);
+    m_UsedMemory += block->size;
+    ++m_Generation;
+    return block;
+}
+
+Expected<const AllocatedBlock*> MemoryManager::mapFile(const AllocArgs& args, const HostFile& file) {
+    if (file.fd < 0)
+        return Unexpected(Error::InvalidArgument);
+
+    // Partial pages would be shared with neighbours.
+    const auto pageSize = hostPageSize();
+    if ((file.offset % pageSize) || (args.size % pageSize))
+        return Unexpected(Error::InvalidAlignment);
+
+    // Pages past the end of the file would fault when touched, the last partial page is zero filled.
+    DASHLE_TRY_OPTIONAL_CONST(fileSize, hostFileSize(file.fd), Error::InvalidArgument);
+    if (file.offset > fileSize)
+        return Unexpected(Error::InvalidArgument);
+
+    DASHLE_TRY_EXPECTED_CONST(mappableSize, dashle::alignUp(fileSize - file.offset, pageSize));
+    if (args.size > mappableSize)
+        return Unexpected(Error::InvalidArgument);
+
+    auto alignedArgs = args;
+    alignedArgs.alignment = std::max(args.alignment, pageSize);
+    return allocate(alignedArgs, &file);
 }
 
 Expected<void> MemoryManager::free(uaddr vbase) {
-    auto& allocatedBlocks = m_Data->allocatedBlocks;
-    auto& freeBlocks = m_Data->freeBlocks;
+    std::scoped_lock lock(m_Data->lock);
+    auto& freeBlocksByAddr = m_Data->freeBlocksByAddr;
 
     // Find allocated block.
-    auto it = allocatedBlocks.find({.virtualBase = vbase});
-    if (it == allocatedBlocks.end() || it->virtualBase != vbase)
+    const auto allocatedBlock = m_Data->findAllocatedBlock(vbase);
+    if (!allocatedBlock)
         return Unexpected(Error::NotFound);
 
     // Handle merging with previous and next blocks.
+    auto block = *allocatedBlock;
     auto newFreeBlock = FreeBlock{
-        .virtualBase = it->virtualBase,
-        .size = it->size
-    };
-
-    const auto handleBlock = [&newFreeBlock=newFreeBlock](FreeBlockSet& freeBlocks, const FreeBlock& block, bool prev) {
-        const auto freeBlockIt = freeBlocks.find(block);
-        DASHLE_ASSERT(freeBlockIt != freeBlocks.end());
-        // Update new free block.
-        if (prev)
-            newFreeBlock.virtualBase = freeBlockIt->virtualBase;
-        newFreeBlock.size += freeBlockIt->size;
-        // Erase old free block.
-        freeBlocks.erase(freeBlockIt);
+        .virtualBase = block.virtualBase,
+        .size = block.size
     };
 
-    if (it != allocatedBlocks.begin()) {
-        // Pick the previous block from the set, which is necessarily an allocated block. Since we sort by
-        // virtual address, we know it's also the previous block in the address space.
-        // By the way the allocation algorithm works, between two allocated blocks there can only be a single
-        // free block, so either the previous block end matches with our block start, or it matches with the
-        // start of a free block. In the latter case we will merge the two blocks.
-        const auto prevAllocBlock = std::prev(it);
-        const auto prevAllocBlockEnd = prevAllocBlock->virtualBase + prevAllocBlock->size;
-        if (prevAllocBlockEnd != it->virtualBase) {
-            const auto prevFreeBlock = FreeBlock{
-                .virtualBase = prevAllocBlockEnd,
-                .size = it->virtualBase - prevAllocBlockEnd
-            };
-            handleBlock(freeBlocks, prevFreeBlock, true);
-        }
-    } else {
-        // Handle the case where this is the first allocated block of the set but not the first block in
-        // the address space (ie. address space starts with a free block).
-        if (it->virtualBase != 0u) {
-            const auto firstFreeBlock = FreeBlock{
-                .virtualBase = 0u,
-                .size = it->virtualBase,
-            };
-            handleBlock(freeBlocks, firstFreeBlock, true);
+    // Free blocks are always merged, so there can be at most one free neighbour on each side.
+    if (auto nextIt = freeBlocksByAddr.lower_bound(newFreeBlock); nextIt != freeBlocksByAddr.begin()) {
+        const auto prevFreeBlock = *std::prev(nextIt);
+        if ((prevFreeBlock.virtualBase + prevFreeBlock.size) == newFreeBlock.virtualBase) {
+            newFreeBlock.virtualBase = prevFreeBlock.virtualBase;
+            newFreeBlock.size += prevFreeBlock.size;
+            m_Data->eraseFreeBlock(prevFreeBlock);
         }
     }
 
-    if (const auto nextAllocBlock = std::next(it); nextAllocBlock != allocatedBlocks.end()) {
-        // Same as above, except we check for the next allocated block.
-        const auto thisAllocBlockEnd = it->virtualBase + it->size;
-        if (thisAllocBlockEnd != nextAllocBlock->virtualBase) {
-            const auto nextFreeBlock = FreeBlock{
-                .virtualBase = thisAllocBlockEnd,
-                .size = nextAllocBlock->virtualBase - thisAllocBlockEnd
-            };
-            handleBlock(freeBlocks, nextFreeBlock, false);
-        }
-    } else {
-        // Handle the case where this is the last allocated block, but not the last in memory (ie. last
-        // block is a free one).
-        if ((it->virtualBase + it->size) != maxMemory()) {
-            const auto thisAllocBlockEnd = it->virtualBase + it->size;
-            const auto lastFreeBlock = FreeBlock{
-                .virtualBase = thisAllocBlockEnd,
-                .size = maxMemory() - thisAllocBlockEnd
-            };
-            handleBlock(freeBlocks, lastFreeBlock, false);
-        }
+    if (auto nextIt = freeBlocksByAddr.find(FreeBlock{ .virtualBase = block.virtualBase + block.size }); nextIt != freeBlocksByAddr.end()) {
+        const auto nextFreeBlock = *nextIt;
+        newFreeBlock.size += nextFreeBlock.size;
+        m_Data->eraseFreeBlock(nextFreeBlock);
     }
 
-    // Free host space and add new free block.
-    auto node = allocatedBlocks.extract(it);
-    hostFree(node.value());
-    m_UsedMemory -= node.value().size;
-    freeBlocks.insert(newFreeBlock);
+    // Unpublish the block before releasing its host space.
+    m_Data->eraseAllocatedBlock(allocatedBlock);
+    hostFree(block);
+    m_UsedMemory -= block.size;
+    m_Data->insertFreeBlock(newFreeBlock);
+    ++m_Generation;
     return EXPECTED_VOID;
 }
 
 Expected<usize> MemoryManager::setFlags(uaddr vbase, usize flags) {
-    return blockFromVAddr(vbase).and_then([vbase, flags](const AllocatedBlock* block) -> Expected<usize> {
-        if (block->virtualBase == vbase) {
-            const auto oldFlags = block->flags;
-            const_cast<AllocatedBlock*>(block)->flags = flags;
-            return oldFlags;
+    std::scoped_lock lock(m_Data->lock);
+
+    // Only writers replace blocks, so the published one can be used as long as the lock is held.
+    const auto block = m_Data->findAllocatedBlock(vbase);
+    if (!block)
+        return Unexpected(blockFromVAddr(vbase) ? Error::InvalidAddress : Error::NotFound);
+
+    // Published blocks are immutable.
+    const auto oldFlags = block->flags;
+    const auto newFlags = (block->flags & ~flags::PERM_MASK) | (flags & flags::PERM_MASK);
+    m_HostAllocator->protect(*m_Data->replaceAllocatedBlock(block, newFlags));
+    ++m_Generation;
+    return oldFlags;
+}
+
+// Host memory for the range starting at vaddr, up to the end of its block.
+static Expected<std::span<u8>> hostSpan(const MemoryManager& mem, uaddr vaddr, usize size, usize perms) {
+    DASHLE_TRY_EXPECTED_CONST(block, mem.blockFromVAddr(vaddr));
+    if ((block.flags & perms) != perms)
+        return Unexpected(Error::PermissionDenied);
+
+    const auto offset = vaddr - block.virtualBase;
+    return std::span(reinterpret_cast<u8*>(block.hostBase + offset), std::min(size, block.size - offset));
+}
+
+// Host memory for the range ending at end, down to the start of its block.
+static Expected<std::span<u8>> hostSpanBefore(const MemoryManager& mem, uaddr end, usize size, usize perms) {
+    DASHLE_TRY_EXPECTED_CONST(block, mem.blockFromVAddr(end - 1u));
+    if ((block.flags & perms) != perms)
+        return Unexpected(Error::PermissionDenied);
+
+    const auto length = std::min(size, end - block.virtualBase);
+    return std::span(reinterpret_cast<u8*>(block.hostBase + (end - block.virtualBase) - length), length);
+}
+
+// Inner loops are left to the libc string functions, which are vectorized.
+
+Expected<void> MemoryManager::read(uaddr vaddr, void* buffer, usize size) const {
+    auto dst = static_cast<u8*>(buffer);
+    while (size) {
+        DASHLE_TRY_EXPECTED_CONST(span, hostSpan(*this, vaddr, size, flags::PERM_READ));
+        std::memcpy(dst, span.data(), span.size());
+        dst += span.size();
+        vaddr += span.size();
+        size -= span.size();
+    }
+
+    return EXPECTED_VOID;
+}
+
+Expected<void> MemoryManager::write(uaddr vaddr, const void* buffer, usize size) {
+    auto src = static_cast<const u8*>(buffer);
+    while (size) {
+        DASHLE_TRY_EXPECTED_CONST(span, hostSpan(*this, vaddr, size, flags::PERM_WRITE));
+        std::memcpy(span.data(), src, span.size());
+        src += span.size();
+        vaddr += span.size();
+        size -= span.size();
+    }
+
+    return EXPECTED_VOID;
+}
+
+Expected<void> MemoryManager::copy(uaddr dst, uaddr src, usize size) {
+    // Go backwards if the destination overlaps the end of the source.
+    if (dst > src && (dst - src) < size) {
+        auto srcEnd = src + size;
+        auto dstEnd = dst + size;
+        while (size) {
+            DASHLE_TRY_EXPECTED_CONST(srcSpan, hostSpanBefore(*this, srcEnd, size, flags::PERM_READ));
+            DASHLE_TRY_EXPECTED_CONST(dstSpan, hostSpanBefore(*this, dstEnd, srcSpan.size(), flags::PERM_WRITE));
+            std::memmove(dstSpan.data(), srcSpan.data() + (srcSpan.size() - dstSpan.size()), dstSpan.size());
+            srcEnd -= dstSpan.size();
+            dstEnd -= dstSpan.size();
+            size -= dstSpan.size();
         }
 
-        return Unexpected(Error::InvalidAddress);
-    });
-}
\ No newline at end of file
+        return EXPECTED_VOID;
+    }
+
+    while (size) {
+        DASHLE_TRY_EXPECTED_CONST(srcSpan, hostSpan(*this, src, size, flags::PERM_READ));
+        DASHLE_TRY_EXPECTED_CONST(dstSpan, hostSpan(*this, dst, srcSpan.size(), flags::PERM_WRITE));
+        std::memmove(dstSpan.data(), srcSpan.data(), dstSpan.size());
+        src += dstSpan.size();
+        dst += dstSpan.size();
+        size -= dstSpan.size();
+    }
+
+    return EXPECTED_VOID;
+}
+
+Expected<void> MemoryManager::fill(uaddr vaddr, u8 value, usize size) {
+    while (size) {
+        DASHLE_TRY_EXPECTED_CONST(span, hostSpan(*this, vaddr, size, flags::PERM_WRITE));
+        std::memset(span.data(), value, span.size());
+        vaddr += span.size();
+        size -= span.size();
+    }
+
+    return EXPECTED_VOID;
+}
+
+Expected<s32> MemoryManager::compare(uaddr a, uaddr b, usize size) const {
+    while (size) {
+        DASHLE_TRY_EXPECTED_CONST(aSpan, hostSpan(*this, a, size, flags::PERM_READ));
+        DASHLE_TRY_EXPECTED_CONST(bSpan, hostSpan(*this, b, aSpan.size(), flags::PERM_READ));
+        if (const auto ret = std::memcmp(aSpan.data(), bSpan.data(), bSpan.size()))
+            return ret < 0 ? -1 : 1;
+
+        a += bSpan.size();
+        b += bSpan.size();
+        size -= bSpan.size();
+    }
+
+    return 0;
+}
+
+Expected<Optional<uaddr>> MemoryManager::find(uaddr vaddr, u8 value, usize size) const {
+    while (size) {
+        DASHLE_TRY_EXPECTED_CONST(span, hostSpan(*this, vaddr, size, flags::PERM_READ));
+        if (const auto ptr = std::memchr(span.data(), value, span.size()))
+            return vaddr + (static_cast<const u8*>(ptr) - span.data());
+
+        vaddr += span.size();
+        size -= span.size();
+    }
+
+    return Optional<uaddr>();
+}
+
+Optional<usize> MemoryManager::residentMemory() const {
+    std::scoped_lock lock(m_Data->lock);
+    return m_HostAllocator->residentMemory(m_Data->allocatedBlocks());
+}
+
+Expected<std::shared_ptr<const MemorySnapshot>> MemoryManager::snapshot() const {
+    std::scoped_lock lock(m_Data->lock);
+    const auto blocks = m_Data->allocatedBlocks();
+    auto image = m_HostAllocator->capture(blocks);
+    if (!image)
+        return Unexpected(Error::NoHostMemory);
+
+    auto snapshot = std::make_shared<MemorySnapshot>();
+    snapshot->maxMemory = maxMemory();
+    snapshot->image = std::move(image);
+    snapshot->blocks.reserve(blocks.size());
+    for (const auto block : blocks)
+        snapshot->blocks.push_back(*block);
+
+    return snapshot;
+}
+
+Expected<void> MemoryManager::restore(const MemorySnapshot& snapshot) {
+    if (snapshot.maxMemory != maxMemory())
+        return Unexpected(Error::InvalidSize);
+
+    std::scoped_lock lock(m_Data->lock);
+    const auto current = m_Data->allocatedBlocks();
+    auto blocks = snapshot.blocks;
+    if (!m_HostAllocator->restore(*snapshot.image, current, blocks))
+        return Unexpected(Error::NoHostMemory);
+
+    // Publish the restored blocks all at once.
+    std::vector<const AllocatedBlock*> slots;
+    slots.reserve(blocks.size());
+    for (const auto& block : blocks)
+        slots.push_back(m_Data->newAllocatedBlock(block));
+
+    visitBlockTree(m_Data->currentTree(), [this](const BlockNode* node) { m_Data->replacedNodes.push_back(node); });
+    m_Data->publishTree(buildBlockTree(slots));
+    for (const auto block : current)
+        m_Data->retireAllocatedBlock(block);
+
+    // Free blocks are the gaps between allocated ones.
+    m_Data->freeBlocks.clear();
+    m_Data->freeBlocksByAddr.clear();
+    uaddr cursor = 0u;
+    usize usedMemory = 0u;
+    for (const auto& block : blocks) {
+        if (block.virtualBase > cursor)
+            m_Data->insertFreeBlock({ .virtualBase = cursor, .size = block.virtualBase - cursor });
+
+        cursor = block.virtualBase + block.size;
+        usedMemory += block.size;
+    }
+
+    if (cursor < maxMemory())
+        m_Data->insertFreeBlock({ .virtualBase = cursor, .size = maxMemory() - cursor });
+
+    m_UsedMemory = usedMemory;
+    ++m_Generation;
+    return EXPECTED_VOID;
+}
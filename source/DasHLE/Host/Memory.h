@@ -4,6 +4,8 @@
 #include "DasHLE/Support/Types.h"
 
 #include <memory>
+#include <atomic>
+#include <vector>
 
 namespace dashle::host::memory {
 
@@ -13,12 +15,29 @@ constexpr static usize PERM_READ = 0b0001;  // Read permission.
 constexpr static usize PERM_WRITE = 0b0010; // Write permission.
 constexpr static usize PERM_EXEC = 0b0100;  // Execute permission.
 constexpr static usize FORCE_HINT = 0b1000; // Fail if couldn't allocate at the specified address.
+constexpr static usize LAZY_COMMIT = 0b10000; // Only reserve host memory, pages are committed on first touch.
 
 constexpr static usize PERM_READ_WRITE = PERM_READ | PERM_WRITE;
 constexpr static usize PERM_MASK = 0b0111;
+constexpr static usize BLOCK_MASK = PERM_MASK | LAZY_COMMIT; // Flags kept by allocated blocks.
 
 }; // namespace dashle::host::memory::flags
 
+constexpr static usize HUGE_PAGE_SIZE = 0x200000; // 2MB
+
+enum class HugePages {
+    None,        // Regular pages only.
+    Transparent, // Ask the host to back large blocks with transparent huge pages.
+    Explicit,    // Map large blocks from the host huge page pool, falling back to regular pages when empty.
+};
+
+// Host file range backing a block, see MemoryManager::mapFile.
+struct HostFile {
+    int fd = -1;
+    u64 offset = 0u;     // Must be page aligned.
+    bool shared = false; // Writes go to the file and are visible to other mappings, rather than to private copies.
+};
+
 struct AllocatedBlock {
     uaddr hostBase = 0u;
     uaddr virtualBase = 0u;
@@ -26,13 +45,77 @@ struct AllocatedBlock {
     usize flags = 0u;
 };
 
+// Contents of the allocated memory at some point in time, as captured by an allocator.
+class HostImage {
+public:
+    virtual ~HostImage() {}
+};
+
 class HostAllocator {
 public:
     virtual ~HostAllocator() {}
-    virtual bool initialize() { return true; }
+    virtual bool initialize([[maybe_unused]] usize maxMemory) { return true; }
     virtual void finalize() {}
     virtual bool alloc(AllocatedBlock& block);
     virtual void free(AllocatedBlock& block);
+
+    // Back the block with a host file range instead of fresh memory, if supported. Freed like any other block.
+    virtual bool mapFile([[maybe_unused]] AllocatedBlock& block, [[maybe_unused]] const HostFile& file) { return false; }
+
+    // Apply the block permissions to its host memory, if supported.
+    virtual void protect([[maybe_unused]] const AllocatedBlock& block) {}
+
+    // Host memory actually committed for the blocks (sorted by address), if known.
+    virtual Optional<usize> residentMemory([[maybe_unused]] const std::vector<const AllocatedBlock*>& blocks) const { return {}; }
+
+    // Host address mirroring virtual address 0, if the whole address space is mapped linearly.
+    virtual Optional<uaddr> fastmemBase() const { return {}; }
+
+    // Capture the contents of the blocks, sorted by address.
+    virtual std::shared_ptr<const HostImage> capture(const std::vector<const AllocatedBlock*>& blocks);
+
+    // Release the current blocks, then allocate the captured ones and fill them with the captured contents.
+    virtual bool restore(const HostImage& image, const std::vector<const AllocatedBlock*>& current, std::vector<AllocatedBlock>& blocks);
+};
+
+// Reserves a single host region as big as the virtual address space, so that every block lives at
+// reservation + virtualBase. Translation becomes a single add, which the Jit can inline (fastmem).
+// Block permissions are enforced by the host MMU on the pages fully covered by a block; accesses which
+// violate them are reported as guest faults.
+// Images are stored in a memfd, and restored by mapping it privately over the reservation: restored memory
+// shares pages with the image until they are written to.
+// Huge pages only apply to the 2MB aligned parts of blocks, and are lost when restoring an image.
+// Every block is committed lazily: the host populates reserved pages on first touch, no fault handling is needed.
+// Files are mapped in place (zero-copy) when the block and file offset are page aligned; restoring an image turns
+// shared file mappings into private memory.
+class MappedAllocator : public HostAllocator {
+    const HugePages m_HugePages;
+    uaddr m_Base = 0u;
+    usize m_Size = 0u;
+    usize m_PageSize = 0u;
+
+public:
+    MappedAllocator(HugePages hugePages = HugePages::None) : m_HugePages(hugePages) {}
+
+    bool initialize(usize maxMemory) override;
+    void finalize() override;
+    bool alloc(AllocatedBlock& block) override;
+    void free(AllocatedBlock& block) override;
+    bool mapFile(AllocatedBlock& block, const HostFile& file) override;
+    void protect(const AllocatedBlock& block) override;
+    std::shared_ptr<const HostImage> capture(const std::vector<const AllocatedBlock*>& blocks) override;
+    bool restore(const HostImage& image, const std::vector<const AllocatedBlock*>& current, std::vector<AllocatedBlock>& blocks) override;
+    Optional<usize> residentMemory(const std::vector<const AllocatedBlock*>& blocks) const override;
+
+    Optional<uaddr> fastmemBase() const override {
+        if (m_Base)
+            return m_Base;
+
+        return {};
+    }
+
+    // Number of huge pages the host actually backs the reservation with.
+    usize hugePages() const;
 };
 
 struct AllocArgs {
@@ -42,46 +125,110 @@ struct AllocArgs {
     usize flags = host::memory::flags::PERM_READ_WRITE;
 };
 
+// Allocated blocks and their contents, see MemoryManager::snapshot.
+struct MemorySnapshot;
+
+// Safe to share between threads. Lookups never take locks, modifications are serialized.
 class MemoryManager {
     struct Data;
     
     std::unique_ptr<HostAllocator> m_HostAllocator;
     std::unique_ptr<Data> m_Data;
     const usize m_MaxMemory = 0u;
-    usize m_UsedMemory = 0u;
+    std::atomic<usize> m_UsedMemory = 0u;
+    std::atomic<u64> m_Generation = 1u;
 
     void initialize();
     void finalize();
-    bool hostAlloc(AllocatedBlock& block);
+    bool hostAlloc(AllocatedBlock& block, const HostFile* file);
     void hostFree(AllocatedBlock& block);
+    Expected<const AllocatedBlock*> allocate(const AllocArgs& args, const HostFile* file);
 
 public:
     MemoryManager(std::unique_ptr<HostAllocator> allocator, usize maxMemory);
     ~MemoryManager();
 
     usize maxMemory() const { return m_MaxMemory; }
-    usize usedMemory() const { return m_UsedMemory; }
+    usize usedMemory() const { return m_UsedMemory.load(std::memory_order_relaxed); }
     usize availableMemory() const { return maxMemory() - usedMemory(); }
+
+    // Number of free ranges, neighbouring free ranges being merged.
+    usize numFreeBlocks() const;
+
+    // Host memory actually committed, which is less than the used memory for untouched pages.
+    Optional<usize> residentMemory() const;
+    Optional<uaddr> fastmemBase() const { return m_HostAllocator->fastmemBase(); }
+
+    // Incremented every time a translation may have changed, used to invalidate cached translations.
+    u64 generation() const { return m_Generation.load(std::memory_order_acquire); }
     
     // Free all allocated memory and reset internal state.
     void reset();
 
     // Get allocated block from virtual address.
-    Expected<const AllocatedBlock*> blockFromVAddr(uaddr vaddr) const;
+    // Returned by copy: a concurrent free() or setFlags() can recycle the published block once the lookup is done.
+    Expected<AllocatedBlock> blockFromVAddr(uaddr vaddr) const;
 
     // Find an address that can be used for allocation.
     Expected<uaddr> findFreeAddr(usize size, usize alignment = 0u) const;
 
     // Allocate memory, return the virtual address.
-    Expected<const AllocatedBlock*> allocate(const AllocArgs& args);
+    Expected<const AllocatedBlock*> allocate(const AllocArgs& args) { return allocate(args, nullptr); }
+
+    // Allocate a block backed by args.size bytes of a host file, without copying them.
+    // The allocator decides the requirements: MappedAllocator needs page aligned sizes and addresses (use args.alignment),
+    // and files opened for writing if the block is shared and may become writable. The file can be closed afterwards.
+    Expected<const AllocatedBlock*> mapFile(const AllocArgs& args, const HostFile& file);
 
     // Free allocated memory.
     Expected<void> free(uaddr vbase);
 
-    // Set memory flags.
+    // Set memory permissions, other flags are kept.
     Expected<usize> setFlags(uaddr vbase, usize flags);
+
+    // Bulk access: ranges may span several contiguous blocks, permissions are checked once per block.
+
+    // Copy guest memory to the host.
+    Expected<void> read(uaddr vaddr, void* buffer, usize size) const;
+
+    // Copy host memory to the guest.
+    Expected<void> write(uaddr vaddr, const void* buffer, usize size);
+
+    // Copy guest memory, ranges may overlap (memmove).
+    Expected<void> copy(uaddr dst, uaddr src, usize size);
+
+    // Fill guest memory with a byte (memset).
+    Expected<void> fill(uaddr vaddr, u8 value, usize size);
+
+    // Compare guest memory (memcmp), the result has the sign of the difference between the first mismatching bytes.
+    Expected<s32> compare(uaddr a, uaddr b, usize size) const;
+
+    // Find the first occurrence of a byte (memchr). Bytes past it are not accessed.
+    Expected<Optional<uaddr>> find(uaddr vaddr, u8 value, usize size) const;
+
+    // Capture all allocated memory.
+    Expected<std::shared_ptr<const MemorySnapshot>> snapshot() const;
+
+    // Replace all allocated memory with a snapshot from a manager of the same size and allocator type.
+    // Snapshots can be restored any number of times, by any number of managers.
+    Expected<void> restore(const MemorySnapshot& snapshot);
 };
 
+// Host page size.
+usize hostPageSize();
+
+// Size of an host file, if it can be queried.
+Optional<u64> hostFileSize(int fd);
+
+// Host mappings with at least the given permissions, as (base, size) pairs.
+std::vector<std::pair<uaddr, usize>> hostMappings(usize perms = 0u);
+
+// Ask the host to back a range with transparent huge pages.
+bool adviseHugePages(uaddr addr, usize size);
+
+// Number of huge pages backing the host mappings which overlap a range.
+usize hostHugePages(uaddr addr, usize size);
+
 // Translate a virtual address to an host address.
 inline Expected<uaddr> virtualToHost(const AllocatedBlock& block, uaddr vaddr) {
     if (vaddr >= block.virtualBase && vaddr <= (block.virtualBase + block.size))
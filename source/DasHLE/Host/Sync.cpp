@@ -0,0 +1,191 @@
+#include "DasHLE/Host/Sync.h"
+
+#include <atomic>
+#include <limits>
+
+using namespace dashle;
+using namespace dashle::host::sync;
+
+// Mutex word layout, following bionic:
+// bits 0-1 lock state, bits 2-12 recursion counter, bit 13 process shared (ignored), bits 14-15 type, bits 16-31 owner.
+constexpr static u32 STATE_UNLOCKED = 0u;
+constexpr static u32 STATE_LOCKED = 1u;
+constexpr static u32 STATE_CONTENDED = 2u; // Locked, and there may be waiters.
+constexpr static u32 STATE_MASK = 3u;
+constexpr static u32 COUNTER_SHIFT = 2u;
+constexpr static u32 COUNTER_MASK = 0x7FFu << COUNTER_SHIFT;
+constexpr static u32 SHARED_MASK = 1u << 13;
+constexpr static u32 OWNER_SHIFT = 16u;
+
+static std::atomic<WaitHook> s_WaitHook = nullptr;
+
+static void wait(u32& word, u32 expected) {
+    const auto hook = s_WaitHook.load(std::memory_order_relaxed);
+    if (hook)
+        hook(true);
+
+    futexWait(word, expected);
+
+    if (hook)
+        hook(false);
+}
+
+void dashle::host::sync::setWaitHook(WaitHook hook) {
+    s_WaitHook.store(hook, std::memory_order_relaxed);
+}
+
+// Mutex
+
+void dashle::host::sync::mutexInit(u32& word, u32 type) {
+    DASHLE_ASSERT(!(type & ~mutex::TYPE_MASK));
+    std::atomic_ref<u32>(word).store(type, std::memory_order_relaxed);
+}
+
+Expected<void> dashle::host::sync::mutexLock(u32& word, u32 owner) {
+    DASHLE_ASSERT(owner && owner < (1u << (32u - OWNER_SHIFT)));
+
+    std::atomic_ref<u32> ref(word);
+    auto old = ref.load(std::memory_order_relaxed);
+    const auto type = old & mutex::TYPE_MASK;
+    const auto base = old & (mutex::TYPE_MASK | SHARED_MASK);
+
+    // Only recursive and error checking mutexes track their owner.
+    const auto ownerBits = type == mutex::TYPE_NORMAL ? 0u : owner << OWNER_SHIFT;
+    if (ownerBits && (old & STATE_MASK) && (old >> OWNER_SHIFT) == owner) {
+        if (type == mutex::TYPE_ERRORCHECK)
+            return Unexpected(Error::Duplicate);
+
+        if ((old & COUNTER_MASK) == COUNTER_MASK)
+            return Unexpected(Error::InvalidSize);
+
+        // Other threads may only flag contention, which doesn't carry into the counter.
+        ref.fetch_add(1u << COUNTER_SHIFT, std::memory_order_relaxed);
+        return EXPECTED_VOID;
+    }
+
+    // Fast path.
+    auto expected = base;
+    if (ref.compare_exchange_strong(expected, base | ownerBits | STATE_LOCKED, std::memory_order_acquire, std::memory_order_relaxed))
+        return EXPECTED_VOID;
+
+    // Flag contention and sleep until unlocked, then take the lock as contended since others may still be waiting.
+    old = expected;
+    while (true) {
+        const auto state = old & STATE_MASK;
+        if (state == STATE_UNLOCKED) {
+            if (ref.compare_exchange_weak(old, base | ownerBits | STATE_CONTENDED, std::memory_order_acquire, std::memory_order_relaxed))
+                return EXPECTED_VOID;
+
+            continue;
+        }
+
+        if (state == STATE_LOCKED) {
+            const auto contended = (old & ~STATE_MASK) | STATE_CONTENDED;
+            if (!ref.compare_exchange_weak(old, contended, std::memory_order_relaxed))
+                continue;
+
+            old = contended;
+        }
+
+        wait(word, old);
+        old = ref.load(std::memory_order_relaxed);
+    }
+}
+
+Expected<void> dashle::host::sync::mutexUnlock(u32& word, u32 owner) {
+    std::atomic_ref<u32> ref(word);
+    const auto old = ref.load(std::memory_order_relaxed);
+    const auto type = old & mutex::TYPE_MASK;
+
+    if (type != mutex::TYPE_NORMAL) {
+        if (!(old & STATE_MASK) || (old >> OWNER_SHIFT) != owner)
+            return Unexpected(Error::PermissionDenied);
+
+        if (old & COUNTER_MASK) {
+            ref.fetch_sub(1u << COUNTER_SHIFT, std::memory_order_relaxed);
+            return EXPECTED_VOID;
+        }
+    }
+
+    if ((ref.exchange(old & (mutex::TYPE_MASK | SHARED_MASK), std::memory_order_release) & STATE_MASK) == STATE_CONTENDED)
+        futexWake(word, 1u);
+
+    return EXPECTED_VOID;
+}
+
+// Condition variable
+// The word is a sequence number, waiters sleep until it changes.
+
+void dashle::host::sync::condInit(u32& word) {
+    std::atomic_ref<u32>(word).store(0u, std::memory_order_relaxed);
+}
+
+void dashle::host::sync::condSignal(u32& word) {
+    std::atomic_ref<u32>(word).fetch_add(1u, std::memory_order_release);
+    futexWake(word, 1u);
+}
+
+void dashle::host::sync::condBroadcast(u32& word) {
+    std::atomic_ref<u32>(word).fetch_add(1u, std::memory_order_release);
+    futexWake(word, std::numeric_limits<s32>::max());
+}
+
+Expected<void> dashle::host::sync::condWait(u32& word, u32& mutexWord, u32 owner) {
+    // Signals sent after the mutex is released change the sequence, so they can't be missed.
+    const auto seq = std::atomic_ref<u32>(word).load(std::memory_order_acquire);
+    DASHLE_TRY_EXPECTED_VOID(mutexUnlock(mutexWord, owner));
+    wait(word, seq);
+    return mutexLock(mutexWord, owner);
+}
+
+// Semaphore
+// The word is the value, or -1 if it's zero and there may be waiters.
+
+constexpr static s32 SEM_WAITERS = -1;
+
+void dashle::host::sync::semInit(u32& word, u32 value) {
+    DASHLE_ASSERT(value <= static_cast<u32>(std::numeric_limits<s32>::max()));
+    std::atomic_ref<u32>(word).store(value, std::memory_order_relaxed);
+}
+
+void dashle::host::sync::semWait(u32& word) {
+    std::atomic_ref<u32> ref(word);
+    auto old = ref.load(std::memory_order_relaxed);
+
+    while (true) {
+        const auto value = static_cast<s32>(old);
+        if (value > 0) {
+            if (ref.compare_exchange_weak(old, static_cast<u32>(value - 1), std::memory_order_acquire, std::memory_order_relaxed))
+                return;
+
+            continue;
+        }
+
+        if (value == 0 && !ref.compare_exchange_weak(old, static_cast<u32>(SEM_WAITERS), std::memory_order_relaxed))
+            continue;
+
+        wait(word, static_cast<u32>(SEM_WAITERS));
+        old = ref.load(std::memory_order_relaxed);
+    }
+}
+
+Expected<void> dashle::host::sync::semPost(u32& word) {
+    std::atomic_ref<u32> ref(word);
+    auto old = ref.load(std::memory_order_relaxed);
+
+    while (true) {
+        const auto value = static_cast<s32>(old);
+        if (value == std::numeric_limits<s32>::max())
+            return Unexpected(Error::InvalidSize);
+
+        const auto next = value < 0 ? 1 : value + 1;
+        if (ref.compare_exchange_weak(old, static_cast<u32>(next), std::memory_order_release, std::memory_order_relaxed))
+            break;
+    }
+
+    // The number of waiters is unknown, those who lose the race flag themselves again.
+    if (static_cast<s32>(old) == SEM_WAITERS)
+        futexWake(word, std::numeric_limits<s32>::max());
+
+    return EXPECTED_VOID;
+}
@@ -0,0 +1,57 @@
+#ifndef _DASHLE_HOST_SYNC_H
+#define _DASHLE_HOST_SYNC_H
+
+#include "DasHLE/Support/Types.h"
+
+namespace dashle::host::sync {
+
+// Block while the word holds the expected value, spurious wakeups are possible.
+void futexWait(u32& word, u32 expected);
+
+// Wake up to count threads blocked on the word.
+void futexWake(u32& word, u32 count);
+
+// Called with true before the synchronization objects below block, and with false once they wake up.
+// Lets a scheduler run other threads meanwhile.
+using WaitHook = void(*)(bool blocked);
+void setWaitHook(WaitHook hook);
+
+// Synchronization objects stored in a single 32 bit word of guest memory, such as the first word of pthread_mutex_t.
+// Uncontended operations are a single atomic operation, contended ones block on a host futex on the word itself.
+
+namespace mutex {
+
+constexpr static u32 TYPE_NORMAL = 0u;           // PTHREAD_MUTEX_INITIALIZER.
+constexpr static u32 TYPE_RECURSIVE = 1u << 14;  // PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP.
+constexpr static u32 TYPE_ERRORCHECK = 2u << 14; // PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP.
+constexpr static u32 TYPE_MASK = 3u << 14;
+
+} // namespace dashle::host::sync::mutex
+
+// Owners identify the calling thread among the running ones, they must be non zero and fit in 16 bits.
+void mutexInit(u32& word, u32 type);
+
+// Fails with Error::Duplicate if an error checking mutex is already owned by the caller,
+// and with Error::InvalidSize if a recursive mutex can't be locked any further.
+Expected<void> mutexLock(u32& word, u32 owner);
+
+// Fails with Error::PermissionDenied if a recursive or error checking mutex is not owned by the caller.
+Expected<void> mutexUnlock(u32& word, u32 owner);
+
+void condInit(u32& word);
+void condSignal(u32& word);
+void condBroadcast(u32& word);
+
+// Unlock the mutex, wait for a signal and lock the mutex again.
+Expected<void> condWait(u32& word, u32& mutexWord, u32 owner);
+
+// Values are at most 0x7FFFFFFF.
+void semInit(u32& word, u32 value);
+void semWait(u32& word);
+
+// Fails with Error::InvalidSize if the value would overflow.
+Expected<void> semPost(u32& word);
+
+} // namespace dashle::host::sync
+
+#endif /* _DASHLE_HOST_SYNC_H */
@@ -1,5 +1,6 @@
 #include "DasHLE/Support/Math.h"
 #include "DasHLE/Guest/ELFVM.h"
+#include "DasHLE/Emulated/Libc.h"
 
 using namespace dashle;
 namespace regs = dashle::guest::arm::regs;
@@ -12,17 +13,24 @@ static_assert(dashle::isPowerOfTwo(PAGE_SIZE));
 constexpr static usize STACK_SIZE = 1024 * 1024; // 1MB
 static_assert(dashle::alignDown<usize>(STACK_SIZE, PAGE_SIZE) == STACK_SIZE);
 
+constexpr static usize MAX_THREADS = 16u;
+
 constexpr usize MEM_4GB = static_cast<usize>(1u) << 32;
 
 // MyVM
 
 class MyVM final : public guest::ELFVM {
     Expected<void> populateBridge() override {
+        auto libc = emulated::libc::LibcContext::getInstance();
+        libc->setMem(m_Mem);
+        libc->setHeap(std::make_shared<host::heap::GuestHeap>(m_Mem));
+        libc->setThreads(m_Threads);
+        emulated::libc::LibcContext::populateBridge(m_Bridge.get());
         return EXPECTED_VOID;
     }
 
 public:
-    MyVM(std::shared_ptr<host::memory::MemoryManager> mem) : ELFVM(mem, PAGE_SIZE, STACK_SIZE) {}
+    MyVM(std::shared_ptr<host::memory::MemoryManager> mem) : ELFVM(mem, PAGE_SIZE, STACK_SIZE, { .maxThreads = MAX_THREADS }) {}
 };
 
 template <typename T>
@@ -35,7 +43,7 @@ static void successOrDie(Expected<T>&& result) {
 int main() {
     // Initialize memory.
     auto mem = std::make_shared<host::memory::MemoryManager>(
-        std::make_unique<host::memory::HostAllocator>(),
+        std::make_unique<host::memory::MappedAllocator>(),
         MEM_4GB);
 
     // Create VM.
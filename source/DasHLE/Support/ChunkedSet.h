@@ -0,0 +1,274 @@
+#ifndef _DASHLE_SUPPORT_CHUNKEDSET_H
+#define _DASHLE_SUPPORT_CHUNKEDSET_H
+
+#include "DasHLE/Support/Types.h"
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+
+namespace dashle {
+
+// Ordered set stored as a sorted list of sorted, fixed capacity chunks (essentially a two level B+tree).
+// Lookups are two binary searches over contiguous memory, insertions and removals only move values within
+// a single chunk. Any modification invalidates iterators and references.
+template <typename T, typename Compare, usize CHUNK_SIZE = 128u>
+requires (std::is_trivially_copyable_v<T> && CHUNK_SIZE >= 4u)
+class ChunkedSet {
+    struct Chunk {
+        usize size = 0u;
+        std::array<T, CHUNK_SIZE> values;
+
+        T* begin() { return values.data(); }
+        T* end() { return values.data() + size; }
+        const T* begin() const { return values.data(); }
+        const T* end() const { return values.data() + size; }
+    };
+
+    std::vector<std::unique_ptr<Chunk>> m_Chunks; // No empty chunks, none at all if the set is empty.
+    std::vector<T> m_Lasts; // Last value of each chunk.
+    usize m_Size = 0u;
+    [[no_unique_address]] Compare m_Comp;
+
+public:
+    class Iterator {
+        friend class ChunkedSet;
+
+        const ChunkedSet* m_Set = nullptr;
+        usize m_Chunk = 0u;
+        usize m_Index = 0u;
+
+        Iterator(const ChunkedSet* set, usize chunk, usize index)
+            : m_Set(set), m_Chunk(chunk), m_Index(index) {}
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        Iterator() {}
+
+        const T& operator*() const { return m_Set->m_Chunks[m_Chunk]->values[m_Index]; }
+        const T* operator->() const { return &**this; }
+
+        Iterator& operator++() {
+            if (++m_Index == m_Set->m_Chunks[m_Chunk]->size) {
+                ++m_Chunk;
+                m_Index = 0u;
+            }
+            return *this;
+        }
+
+        Iterator& operator--() {
+            if (!m_Index) {
+                --m_Chunk;
+                m_Index = m_Set->m_Chunks[m_Chunk]->size;
+            }
+            --m_Index;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+
+        Iterator operator--(int) {
+            auto it = *this;
+            --*this;
+            return it;
+        }
+
+        bool operator==(const Iterator& other) const = default;
+    };
+
+    using iterator = Iterator;
+    using const_iterator = Iterator;
+
+private:
+    // Index of the first chunk whose last value doesn't satisfy pred.
+    template <typename Pred>
+    usize chunkPartition(Pred pred) const {
+        return std::partition_point(m_Lasts.begin(), m_Lasts.end(), pred) - m_Lasts.begin();
+    }
+
+    void splitChunk(usize index) {
+        auto& chunk = *m_Chunks[index];
+        auto next = std::make_unique<Chunk>();
+        constexpr auto HALF = CHUNK_SIZE / 2u;
+        std::copy(chunk.begin() + HALF, chunk.end(), next->begin());
+        next->size = chunk.size - HALF;
+        chunk.size = HALF;
+
+        m_Lasts[index] = chunk.values[chunk.size - 1u];
+        m_Lasts.insert(m_Lasts.begin() + index + 1u, next->values[next->size - 1u]);
+        m_Chunks.insert(m_Chunks.begin() + index + 1u, std::move(next));
+    }
+
+    // Move the values of chunk index + 1 into chunk index, if they both are sparse.
+    bool mergeChunks(usize index) {
+        if (index + 1u >= m_Chunks.size())
+            return false;
+
+        auto& chunk = *m_Chunks[index];
+        const auto& next = *m_Chunks[index + 1u];
+        if (chunk.size + next.size > CHUNK_SIZE / 2u)
+            return false;
+
+        std::copy(next.begin(), next.end(), chunk.end());
+        chunk.size += next.size;
+        m_Lasts[index] = m_Lasts[index + 1u];
+        m_Lasts.erase(m_Lasts.begin() + index + 1u);
+        m_Chunks.erase(m_Chunks.begin() + index + 1u);
+        return true;
+    }
+
+public:
+    ChunkedSet() {}
+    ChunkedSet(const ChunkedSet&) = delete;
+    ChunkedSet(ChunkedSet&&) = default;
+
+    ChunkedSet& operator=(const ChunkedSet&) = delete;
+    ChunkedSet& operator=(ChunkedSet&&) = default;
+
+    usize size() const { return m_Size; }
+    bool empty() const { return !m_Size; }
+
+    Iterator begin() const { return Iterator(this, 0u, 0u); }
+    Iterator end() const { return Iterator(this, m_Chunks.size(), 0u); }
+
+    void clear() {
+        m_Chunks.clear();
+        m_Lasts.clear();
+        m_Size = 0u;
+    }
+
+    // First value not less than key.
+    template <typename K>
+    Iterator lower_bound(const K& key) const {
+        const auto index = chunkPartition([this, &key](const T& last) { return m_Comp(last, key); });
+        if (index == m_Chunks.size())
+            return end();
+
+        const auto& chunk = *m_Chunks[index];
+        const auto it = std::partition_point(chunk.begin(), chunk.end(), [this, &key](const T& value) {
+            return m_Comp(value, key);
+        });
+        return Iterator(this, index, it - chunk.begin());
+    }
+
+    // First value greater than key.
+    template <typename K>
+    Iterator upper_bound(const K& key) const {
+        const auto index = chunkPartition([this, &key](const T& last) { return !m_Comp(key, last); });
+        if (index == m_Chunks.size())
+            return end();
+
+        const auto& chunk = *m_Chunks[index];
+        const auto it = std::partition_point(chunk.begin(), chunk.end(), [this, &key](const T& value) {
+            return !m_Comp(key, value);
+        });
+        return Iterator(this, index, it - chunk.begin());
+    }
+
+    template <typename K>
+    Iterator find(const K& key) const {
+        const auto it = lower_bound(key);
+        if (it != end() && !m_Comp(key, *it))
+            return it;
+
+        return end();
+    }
+
+    // Return false if an equivalent value already exists.
+    bool insert(const T& value) {
+        if (m_Chunks.empty()) {
+            auto chunk = std::make_unique<Chunk>();
+            chunk->values[0] = value;
+            chunk->size = 1u;
+            m_Chunks.push_back(std::move(chunk));
+            m_Lasts.push_back(value);
+            ++m_Size;
+            return true;
+        }
+
+        // Values greater than every other one go in the last chunk.
+        auto index = chunkPartition([this, &value](const T& last) { return m_Comp(last, value); });
+        if (index == m_Chunks.size())
+            --index;
+
+        auto* chunk = m_Chunks[index].get();
+        auto pos = static_cast<usize>(std::partition_point(chunk->begin(), chunk->end(), [this, &value](const T& v) {
+            return m_Comp(v, value);
+        }) - chunk->begin());
+        if (pos != chunk->size && !m_Comp(value, chunk->values[pos]))
+            return false;
+
+        if (chunk->size == CHUNK_SIZE) {
+            splitChunk(index);
+            if (pos > chunk->size) {
+                pos -= chunk->size;
+                chunk = m_Chunks[++index].get();
+            }
+        }
+
+        std::copy_backward(chunk->begin() + pos, chunk->end(), chunk->end() + 1);
+        chunk->values[pos] = value;
+        if (++chunk->size == pos + 1u)
+            m_Lasts[index] = value;
+
+        ++m_Size;
+        return true;
+    }
+
+    // Return an iterator to the value following the removed one.
+    Iterator erase(Iterator it) {
+        DASHLE_ASSERT(it.m_Set == this && it != end());
+
+        auto index = it.m_Chunk;
+        auto pos = it.m_Index;
+        auto& chunk = *m_Chunks[index];
+        std::copy(chunk.begin() + pos + 1u, chunk.end(), chunk.begin() + pos);
+        --chunk.size;
+        --m_Size;
+
+        if (!chunk.size) {
+            m_Chunks.erase(m_Chunks.begin() + index);
+            m_Lasts.erase(m_Lasts.begin() + index);
+            return Iterator(this, index, 0u);
+        }
+
+        m_Lasts[index] = chunk.values[chunk.size - 1u];
+
+        // Keep chunks reasonably full.
+        const auto size = chunk.size;
+        if (!mergeChunks(index) && index && mergeChunks(index - 1u)) {
+            --index;
+            pos += m_Chunks[index]->size - size;
+        }
+
+        if (pos == m_Chunks[index]->size)
+            return Iterator(this, index + 1u, 0u);
+
+        return Iterator(this, index, pos);
+    }
+
+    template <typename K>
+    usize erase(const K& key) {
+        const auto it = find(key);
+        if (it == end())
+            return 0u;
+
+        erase(it);
+        return 1u;
+    }
+};
+
+} // namespace dashle
+
+#endif /* _DASHLE_SUPPORT_CHUNKEDSET_H */
@@ -0,0 +1,144 @@
+#ifndef _DASHLE_SUPPORT_EPOCH_H
+#define _DASHLE_SUPPORT_EPOCH_H
+
+#include "DasHLE/Support/Types.h"
+
+#include <array>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <functional>
+
+// Epoch based reclamation.
+// Readers announce the epoch they entered in; writers unlink objects first, then retire them tagged with the
+// current epoch and reclaim them once every reader has moved past it. Readers never wait nor write shared lines.
+
+namespace dashle {
+
+namespace _impl {
+
+constexpr static usize EPOCH_MAX_THREADS = 256u;
+
+struct alignas(64) EpochSlot {
+    std::atomic<u64> epoch = 0u; // 0 when not reading.
+    std::atomic<bool> used = false;
+    usize nesting = 0u;          // Only touched by the owner.
+};
+
+inline std::atomic<u64> g_Epoch = 1u;
+inline std::array<EpochSlot, EPOCH_MAX_THREADS> g_EpochSlots;
+
+class EpochThreadSlot {
+    EpochSlot* m_Slot = nullptr;
+
+public:
+    EpochThreadSlot() {
+        for (auto& slot : g_EpochSlots) {
+            if (!slot.used.load(std::memory_order_relaxed) && !slot.used.exchange(true, std::memory_order_acquire)) {
+                m_Slot = &slot;
+                return;
+            }
+        }
+
+        DASHLE_UNREACHABLE("Too many threads!");
+    }
+
+    ~EpochThreadSlot() { m_Slot->used.store(false, std::memory_order_release); }
+
+    EpochSlot& get() { return *m_Slot; }
+};
+
+inline EpochSlot& epochThreadSlot() {
+    thread_local EpochThreadSlot slot;
+    return slot.get();
+}
+
+} // namespace dashle::_impl
+
+// Read side critical section, objects loaded while it's alive won't be reclaimed. Can be nested.
+class EpochGuard {
+    _impl::EpochSlot& m_Slot;
+
+public:
+    EpochGuard() : m_Slot(_impl::epochThreadSlot()) {
+        if (!m_Slot.nesting++)
+            m_Slot.epoch.store(_impl::g_Epoch.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+    }
+
+    ~EpochGuard() {
+        if (!--m_Slot.nesting)
+            m_Slot.epoch.store(0u, std::memory_order_release);
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+// Deferred reclamation for a single writer (or writers serialized by a lock).
+class EpochReclaimer {
+    constexpr static usize COLLECT_THRESHOLD = 64u;
+
+    struct Retired {
+        u64 epoch;
+        std::function<void()> reclaim;
+    };
+
+    std::vector<Retired> m_Retired;
+
+    // Oldest epoch a reader may still be in.
+    static u64 minActiveEpoch() {
+        auto min = static_cast<u64>(-1);
+        for (const auto& slot : _impl::g_EpochSlots) {
+            const auto epoch = slot.epoch.load(std::memory_order_seq_cst);
+            if (epoch && epoch < min)
+                min = epoch;
+        }
+
+        return min;
+    }
+
+public:
+    EpochReclaimer() {}
+    ~EpochReclaimer() { synchronize(); }
+
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+    // The object must be unreachable for new readers before retiring it.
+    void retire(std::function<void()> reclaim) {
+        m_Retired.push_back({ .epoch = _impl::g_Epoch.fetch_add(1u, std::memory_order_seq_cst), .reclaim = std::move(reclaim) });
+        if (m_Retired.size() >= COLLECT_THRESHOLD)
+            collect();
+    }
+
+    template <typename T>
+    void retireObject(const T* obj) {
+        retire([obj] { delete obj; });
+    }
+
+    // Reclaim objects no reader can reference anymore.
+    void collect() {
+        const auto min = minActiveEpoch();
+        std::erase_if(m_Retired, [min](Retired& retired) {
+            if (retired.epoch < min) {
+                retired.reclaim();
+                return true;
+            }
+
+            return false;
+        });
+    }
+
+    // Wait for all retired objects to be reclaimed.
+    void synchronize() {
+        collect();
+        while (!m_Retired.empty()) {
+            std::this_thread::yield();
+            collect();
+        }
+    }
+};
+
+} // namespace dashle
+
+#endif /* _DASHLE_SUPPORT_EPOCH_H */
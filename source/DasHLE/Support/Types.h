@@ -89,6 +89,7 @@ enum class Error {
     InvalidArgument,
     Duplicate,
     InvalidOperation,
+    PermissionDenied,
 };
 
 enum class GuestVersion {
@@ -1,10 +1,13 @@
 #ifndef _DASHLE_TEST_H
 #define _DASHLE_TEST_H
 
-#include "Base.h"
+#include "DasHLE/Support/Types.h"
 
 #include <chrono>
+#include <cstdio>
+#include <ctime>
 #include <format>
+#include <string_view>
 
 using namespace dashle;
 
@@ -26,8 +29,15 @@ public:
     double stop() { return getNow() - m_Start; }
 };
 
+// Unlike DASHLE_LOG_LINE, test output is kept in release builds.
+inline void log(std::string_view msg) {
+    std::printf("%.*s\n", static_cast<int>(msg.size()), msg.data());
 }
 
+}
+
+#define DASHLE_LOG(msg) ::dashle_test::log(msg)
+
 template <usize MIN_SIZE, usize MAX_SIZE>
 inline usize randomSize() requires(MAX_SIZE >= MIN_SIZE) {
     return MIN_SIZE + (rand() % (MAX_SIZE - MIN_SIZE));
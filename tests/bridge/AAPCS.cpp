@@ -0,0 +1,94 @@
+#include "DasHLE/Host/AAPCS.h"
+#include "Test.h"
+
+namespace bridge = dashle::host::bridge;
+namespace aapcs = dashle::host::bridge::aapcs;
+namespace memory = dashle::host::memory;
+
+using aapcs::FloatABI;
+using aapcs::Location;
+using aapcs::Where;
+
+constexpr static usize STACK_SIZE = 0x1000;
+
+// 64 bit values take an even register pair, then arguments spill on the stack.
+static_assert(aapcs::layout<FloatABI::Soft, u32, u64, u32, u32>() == std::array {
+    Location { Where::Core, 0u }, Location { Where::Core, 2u }, Location { Where::Stack, 0u }, Location { Where::Stack, 4u } });
+static_assert(aapcs::layout<FloatABI::Soft, u32, u32, u32, u64, u32>() == std::array {
+    Location { Where::Core, 0u }, Location { Where::Core, 1u }, Location { Where::Core, 2u }, Location { Where::Stack, 0u }, Location { Where::Stack, 8u } });
+static_assert(aapcs::layout<FloatABI::Soft, u32, u32, u32, u32, u32, u64>() == std::array {
+    Location { Where::Core, 0u }, Location { Where::Core, 1u }, Location { Where::Core, 2u }, Location { Where::Core, 3u }, Location { Where::Stack, 0u }, Location { Where::Stack, 8u } });
+
+// Floating point values go in core registers with softfp, and get back-filled in VFP registers with hardfp.
+static_assert(aapcs::layout<FloatABI::Soft, float, double>() == std::array { Location { Where::Core, 0u }, Location { Where::Core, 2u } });
+static_assert(aapcs::layout<FloatABI::Hard, float, double, float, s32>() == std::array {
+    Location { Where::Single, 0u }, Location { Where::Double, 2u }, Location { Where::Single, 1u }, Location { Where::Core, 0u } });
+
+static u64 mix(u32 a, u64 b, u32 c, s16 d, u8 e) {
+    return a + b + c + d + e;
+}
+
+static double scale(float a, double b, s32 c) {
+    return a * b * c;
+}
+
+static s32 negate(s8 value) {
+    return -value;
+}
+
+// Call host functions through a fake guest register file.
+DASHLE_TEST(Bridge::AAPCS) {
+    auto mem = std::make_shared<memory::MemoryManager>(std::make_unique<memory::MappedAllocator>(), 1u << 20);
+    DASHLE_ASSERT_WRAPPER_CONST(stack, mem->allocate({ .size = STACK_SIZE }));
+
+    std::array<u32, 16> regs = {};
+    std::array<u32, 64> extRegs = {};
+    bridge::GuestContext32 ctx = { .regs = &regs, .extRegs = &extRegs, .mem = mem.get() };
+
+    // Register pair and stack arguments, 64 bit result.
+    constexpr u64 B = 0x1'0000'0002;
+    const std::array<u32, 3> stacked = { 3u, static_cast<u32>(-4), 0xFFFFFF05 };
+    regs[13] = stack->virtualBase + STACK_SIZE - sizeof(stacked);
+    DASHLE_ASSERT(mem->write(regs[13], stacked.data(), sizeof(stacked)));
+    regs[0] = 1u;
+    regs[1] = 0xDEADBEEF; // Skipped for alignment.
+    regs[2] = static_cast<u32>(B);
+    regs[3] = static_cast<u32>(B >> 32u);
+    aapcs::call<&mix, FloatABI::Soft>(reinterpret_cast<u64>(&ctx));
+    if ((regs[0] | (static_cast<u64>(regs[1]) << 32u)) != B + 1u + 3u - 4u + 5u) {
+        TEST_FAILED("Wrong core/stack marshalling!");
+    }
+
+    // Narrow results are extended.
+    regs[0] = 0xFFFFFF80;
+    aapcs::call<&negate, FloatABI::Soft>(reinterpret_cast<u64>(&ctx));
+    if (regs[0] != 128u) {
+        TEST_FAILED("Wrong narrow marshalling!");
+    }
+
+    // Softfp.
+    const auto b = std::bit_cast<u64>(4.0);
+    regs[0] = std::bit_cast<u32>(0.5f);
+    regs[2] = static_cast<u32>(b);
+    regs[3] = static_cast<u32>(b >> 32u);
+    regs[13] = stack->virtualBase + STACK_SIZE - sizeof(u32);
+    const auto c = static_cast<u32>(-3);
+    DASHLE_ASSERT(mem->write(regs[13], &c, sizeof(c)));
+    aapcs::call<&scale, FloatABI::Soft>(reinterpret_cast<u64>(&ctx));
+    if (std::bit_cast<double>(regs[0] | (static_cast<u64>(regs[1]) << 32u)) != -6.0) {
+        TEST_FAILED("Wrong softfp marshalling!");
+    }
+
+    // Hardfp.
+    regs = {};
+    extRegs[0] = std::bit_cast<u32>(0.5f);
+    extRegs[2] = static_cast<u32>(b);
+    extRegs[3] = static_cast<u32>(b >> 32u);
+    regs[0] = 3u;
+    aapcs::call<&scale, FloatABI::Hard>(reinterpret_cast<u64>(&ctx));
+    if (std::bit_cast<double>(extRegs[0] | (static_cast<u64>(extRegs[1]) << 32u)) != 6.0 || regs[0] != 3u) {
+        TEST_FAILED("Wrong hardfp marshalling!");
+    }
+
+    TEST_PASSED();
+}
@@ -0,0 +1,45 @@
+#include "DasHLE/Host/Bridge.h"
+#include "Test.h"
+
+#include <string>
+
+namespace bridge = dashle::host::bridge;
+namespace memory = dashle::host::memory;
+
+constexpr static usize NUM_SYMBOLS = 500u;
+
+// Look up symbols in the frozen table.
+DASHLE_TEST(Bridge::Symbols) {
+    auto mem = std::make_shared<memory::MemoryManager>(std::make_unique<memory::MappedAllocator>(), 1u << 20);
+    DASHLE_ASSERT_WRAPPER_CONST(block, mem->allocate({ .size = NUM_SYMBOLS }));
+
+    bridge::Bridge bridge(mem, dashle::BITS_32);
+    for (auto i = 0u; i < NUM_SYMBOLS; ++i) {
+        DASHLE_ASSERT(bridge.registerVariable("var" + std::to_string(i), block->virtualBase + i));
+    }
+
+    if (bridge.addressForSymbol("var0") || bridge.registerVariable("var0", block->virtualBase)) {
+        TEST_FAILED("Symbols were usable before building the table!");
+    }
+
+    DASHLE_ASSERT(bridge.buildIFT());
+    if (bridge.registerVariable("late", block->virtualBase)) {
+        TEST_FAILED("Symbols were registered after building the table!");
+    }
+
+    for (auto i = 0u; i < NUM_SYMBOLS; ++i) {
+        const auto name = "var" + std::to_string(i);
+        if (bridge.addressForSymbol(std::string_view(name)).value_or(0u) != block->virtualBase + i) {
+            TEST_FAILED("Wrong symbol address!");
+        }
+    }
+
+    for (const auto name : { "", "var", "var5000", "late", "zzz" }) {
+        const auto vaddr = bridge.addressForSymbol(name);
+        if (vaddr || vaddr.error() != Error::NotFound) {
+            TEST_FAILED("Found missing symbol!");
+        }
+    }
+
+    TEST_PASSED();
+}
@@ -0,0 +1,62 @@
+#include "DasHLE/Guest/ARM/ARM.h"
+#include "DasHLE/Guest/Profiler.h"
+#include "Test.h"
+
+namespace guest = dashle::guest;
+namespace memory = dashle::host::memory;
+
+constexpr static u32 NUM_ITERATIONS = 100u;
+
+// Counts up to NUM_ITERATIONS, conditional instructions start blocks of their own.
+constexpr static u32 CODE[] = {
+    0xE3A00000,                  // 0x00: mov r0, #0
+    0xE3A01000 | NUM_ITERATIONS, // 0x04: mov r1, #NUM_ITERATIONS
+    0xE2800001,                  // 0x08: add r0, r0, #1
+    0xE1500001,                  // 0x0C: cmp r0, r1
+    0xBAFFFFFC,                  // 0x10: blt 0x08
+    0xE12FFF1E,                  // 0x14: bx lr
+};
+
+constexpr static uaddr LOOP_OFFSET = 0x08;
+constexpr static uaddr CMP_OFFSET = 0x0C;
+
+// Run a loop on a VM, then make sure blocks are counted once per entry rather than once per instruction.
+DASHLE_TEST(Guest::ARMBlockCounters) {
+    auto mem = std::make_shared<memory::MemoryManager>(std::make_unique<memory::MappedAllocator>(), 1u << 30);
+    auto bridge = std::make_shared<dashle::host::bridge::Bridge>(mem, dashle::BITS_32);
+    auto counters = std::make_shared<guest::BlockCounters>();
+
+    const auto ret = mem->allocate({ .size = sizeof(CODE), .alignment = sizeof(u32) });
+    if (!ret) {
+        TEST_FAILED(DASHLE_FORMAT("Allocation failed: {}", errorAsString(ret.error())));
+    }
+
+    const auto code = ret.value()->virtualBase;
+    if (!mem->write(code, CODE, sizeof(CODE)) || !mem->setFlags(code, memory::flags::PERM_READ | memory::flags::PERM_EXEC)) {
+        TEST_FAILED("Could not set up the code!");
+    }
+
+    {
+        guest::arm::ARMVM vm(mem, bridge, GuestVersion::Armeabi_v7a, { .blockCounters = counters });
+        if (vm.execute(code) != guest::VM_EXEC_SUCCESS || vm.returnValue() != NUM_ITERATIONS) {
+            TEST_FAILED("Wrong execution!");
+        }
+    }
+
+    // The loop head is entered by the branch on every iteration but the first.
+    bool loopCounted = false;
+    for (const auto& block : counters->blocks()) {
+        if (block.addr == code + CMP_OFFSET || block.count > NUM_ITERATIONS) {
+            TEST_FAILED(DASHLE_FORMAT("Block 0x{:X} counted {} times!", block.addr - code, block.count));
+        }
+
+        if (block.addr == code + LOOP_OFFSET)
+            loopCounted = block.count == NUM_ITERATIONS - 1u;
+    }
+
+    if (!loopCounted) {
+        TEST_FAILED("Wrong loop count!");
+    }
+
+    TEST_PASSED();
+}
@@ -0,0 +1,78 @@
+#include "DasHLE/Guest/ARM/ARM.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <vector>
+
+namespace guest = dashle::guest;
+namespace memory = dashle::host::memory;
+
+constexpr static usize NUM_VMS = 2u;
+constexpr static u32 NUM_ITERATIONS = 100000u;
+
+// Increment the word at r0 r1 times, retrying failed exclusive stores.
+constexpr static u32 CODE[] = {
+    0xE1902F9F, // 0x00: ldrex r2, [r0]
+    0xE2822001, // 0x04: add r2, r2, #1
+    0xE1803F92, // 0x08: strex r3, r2, [r0]
+    0xE3530000, // 0x0C: cmp r3, #0
+    0x1AFFFFFA, // 0x10: bne 0x00
+    0xE2511001, // 0x14: subs r1, r1, #1
+    0x1AFFFFF8, // 0x18: bne 0x00
+    0xE12FFF1E, // 0x1C: bx lr
+};
+
+// Run the same increment loop on VMs sharing a monitor, no increment may be lost.
+DASHLE_TEST(Guest::ARMExclusive) {
+    auto mem = std::make_shared<memory::MemoryManager>(std::make_unique<memory::MappedAllocator>(), 1u << 30);
+    auto bridge = std::make_shared<dashle::host::bridge::Bridge>(mem, dashle::BITS_32);
+    auto monitor = std::make_shared<dynarmic::ExclusiveMonitor>(NUM_VMS);
+
+    const auto codeRet = mem->allocate({ .size = sizeof(CODE), .alignment = sizeof(u32) });
+    const auto counterRet = mem->allocate({ .size = sizeof(u32), .alignment = sizeof(u32) });
+    if (!codeRet || !counterRet) {
+        TEST_FAILED("Allocation failed!");
+    }
+
+    const auto code = codeRet.value()->virtualBase;
+    const auto counter = counterRet.value()->virtualBase;
+    if (!mem->write(code, CODE, sizeof(CODE)) || !mem->setFlags(code, memory::flags::PERM_READ | memory::flags::PERM_EXEC)
+        || !mem->fill(counter, 0u, sizeof(u32))) {
+        TEST_FAILED("Could not set up the code!");
+    }
+
+    std::array<std::unique_ptr<guest::arm::ARMVM>, NUM_VMS> vms;
+    for (auto i = 0u; i < NUM_VMS; ++i) {
+        vms[i] = std::make_unique<guest::arm::ARMVM>(mem, bridge, GuestVersion::Armeabi_v7a, guest::VMConfig {
+            .maxThreads = NUM_VMS,
+            .exclusiveMonitor = monitor,
+            .processorId = i,
+        });
+        vms[i]->setArgument(0u, counter);
+        vms[i]->setArgument(1u, NUM_ITERATIONS);
+    }
+
+    std::array<bool, NUM_VMS> succeeded = {};
+    std::vector<std::thread> threads;
+    for (auto i = 0u; i < NUM_VMS; ++i) {
+        threads.emplace_back([&vms, &succeeded, code, i] {
+            succeeded[i] = vms[i]->execute(code) == guest::VM_EXEC_SUCCESS;
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    if (std::find(succeeded.begin(), succeeded.end(), false) != succeeded.end()) {
+        TEST_FAILED("Wrong execution!");
+    }
+
+    u32 value = 0u;
+    if (!mem->read(counter, &value, sizeof(u32)) || value != NUM_VMS * NUM_ITERATIONS) {
+        TEST_FAILED(DASHLE_FORMAT("Lost increments, counted {} out of {}!", value, NUM_VMS * NUM_ITERATIONS));
+    }
+
+    TEST_PASSED();
+}
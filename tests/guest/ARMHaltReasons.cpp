@@ -0,0 +1,80 @@
+#include "DasHLE/Guest/ARM/ARM.h"
+#include "Test.h"
+
+#include <array>
+
+namespace guest = dashle::guest;
+namespace memory = dashle::host::memory;
+
+constexpr static usize STACK_SIZE = 0x10000;
+
+// Halt reasons requested by the host function, one per call.
+constexpr static dynarmic::HaltReason HALTS[] = { guest::halt::YIELD, guest::halt::WATCHDOG, guest::halt::BREAKPOINT };
+constexpr static u32 NUM_HALTS = std::size(HALTS);
+
+static u32 g_NumCalls = 0u;
+
+static void haltWith(u32 index) {
+    ++g_NumCalls;
+    guest::VM::current()->halt(HALTS[index]);
+}
+
+// Call the host function with indices 0 to NUM_HALTS - 1, return the number of calls.
+static std::array<u32, 11u> haltCode(u32 function) {
+    return {
+        0xE92D4010,             // 0x00: push {r4, lr}
+        0xE3A04000,             // 0x04: mov r4, #0
+        0xE1A00004,             // 0x08: mov r0, r4
+        0xE59FC014,             // 0x0C: ldr r12, [pc, #20]
+        0xE12FFF3C,             // 0x10: blx r12
+        0xE2844001,             // 0x14: add r4, r4, #1
+        0xE3540000 | NUM_HALTS, // 0x18: cmp r4, #NUM_HALTS
+        0xBAFFFFF9,             // 0x1C: blt 0x08
+        0xE1A00004,             // 0x20: mov r0, r4
+        0xE8BD8010,             // 0x24: pop {r4, pc}
+        function,               // 0x28: .word function
+    };
+}
+
+// Yields are handled by the run loop, other reasons stop execution, which then resumes where it stopped.
+DASHLE_TEST(Guest::ARMHaltReasons) {
+    auto mem = std::make_shared<memory::MemoryManager>(std::make_unique<memory::MappedAllocator>(), 1u << 30);
+    auto bridge = std::make_shared<dashle::host::bridge::Bridge>(mem, dashle::BITS_32);
+    DASHLE_ASSERT((bridge->registerFunction<dashle::BITS_32, &haltWith>("haltWith")));
+    DASHLE_ASSERT(bridge->buildIFT());
+    DASHLE_ASSERT_WRAPPER_CONST(function, bridge->addressForSymbol("haltWith"));
+
+    const auto code = haltCode(function);
+    const auto codeRet = mem->allocate({ .size = sizeof(code), .alignment = sizeof(u32) });
+    const auto stack = mem->allocate({ .size = STACK_SIZE, .alignment = sizeof(u64) });
+    if (!codeRet || !stack) {
+        TEST_FAILED("Allocation failed!");
+    }
+
+    const auto codeBase = codeRet.value()->virtualBase;
+    if (!mem->write(codeBase, code.data(), sizeof(code)) || !mem->setFlags(codeBase, memory::flags::PERM_READ | memory::flags::PERM_EXEC)) {
+        TEST_FAILED("Could not set up the code!");
+    }
+
+    guest::arm::ARMVM vm(mem, bridge, GuestVersion::Armeabi_v7a);
+    vm.setStackPointer(stack.value()->virtualBase + STACK_SIZE);
+
+    // The yield of the first call doesn't reach the caller.
+    auto reason = vm.execute(codeBase);
+    if (reason != guest::halt::WATCHDOG || g_NumCalls != 2u) {
+        TEST_FAILED(DASHLE_FORMAT("Expected a watchdog halt after 2 calls, got 0x{:X} after {}!", static_cast<u32>(reason), g_NumCalls));
+    }
+
+    reason = vm.execute();
+    if (reason != guest::halt::BREAKPOINT || g_NumCalls != 3u) {
+        TEST_FAILED(DASHLE_FORMAT("Expected a breakpoint halt after 3 calls, got 0x{:X} after {}!", static_cast<u32>(reason), g_NumCalls));
+    }
+
+    // Resumed calls end on the return address rather than succeeding.
+    reason = vm.execute();
+    if (!dynarmic::Has(reason, guest::halt::RETURNED) || vm.returnValue() != NUM_HALTS || g_NumCalls != NUM_HALTS) {
+        TEST_FAILED(DASHLE_FORMAT("Execution didn't resume correctly, got 0x{:X} and {}!", static_cast<u32>(reason), vm.returnValue()));
+    }
+
+    TEST_PASSED();
+}
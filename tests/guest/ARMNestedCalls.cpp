@@ -0,0 +1,101 @@
+#include "DasHLE/Guest/ARM/ARM.h"
+#include "DasHLE/Emulated/Libc.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <array>
+
+namespace guest = dashle::guest;
+namespace memory = dashle::host::memory;
+namespace libc = dashle::emulated::libc;
+
+constexpr static u32 NUM_ELEMENTS = 64u;
+constexpr static usize STACK_SIZE = 0x10000;
+
+// Call the function whose address follows, with the arguments received.
+static std::array<u32, 5u> trampoline(u32 target) {
+    return {
+        0xE52DE004, // 0x00: push {lr}
+        0xE59FC004, // 0x04: ldr r12, [pc, #4]
+        0xE12FFF3C, // 0x08: blx r12
+        0xE49DF004, // 0x0C: pop {pc}
+        target,     // 0x10: .word target
+    };
+}
+
+// Compare the words pointed to by r0 and r1.
+constexpr static u32 COMPARE_CODE[] = {
+    0xE5900000, // ldr r0, [r0]
+    0xE5911000, // ldr r1, [r1]
+    0xE0400001, // sub r0, r0, r1
+    0xE12FFF1E, // bx lr
+};
+
+// Call the guest function back through the host until calls can't nest any further, return the number of levels.
+static u32 recurse(u32 function) {
+    const auto ret = guest::VM::current()->call(function, function);
+    return ret ? static_cast<u32>(ret.value()) + 1u : 0u;
+}
+
+static Expected<uaddr> loadCode(memory::MemoryManager& mem, std::span<const u32> code) {
+    DASHLE_TRY_EXPECTED_CONST(block, mem.allocate({ .size = code.size_bytes(), .alignment = sizeof(u32) }));
+    DASHLE_TRY_EXPECTED_VOID(mem.write(block->virtualBase, code.data(), code.size_bytes()));
+    DASHLE_TRY_EXPECTED_VOID(mem.setFlags(block->virtualBase, memory::flags::PERM_READ | memory::flags::PERM_EXEC));
+    return block->virtualBase;
+}
+
+// Sort through qsort from guest code, with a guest comparator called back from the host.
+// Then nest calls between guest and host code until the depth limit stops them.
+DASHLE_TEST(Guest::ARMNestedCalls) {
+    auto mem = std::make_shared<memory::MemoryManager>(std::make_unique<memory::MappedAllocator>(), 1u << 30);
+    auto bridge = std::make_shared<dashle::host::bridge::Bridge>(mem, dashle::BITS_32);
+    libc::LibcContext::getInstance()->setMem(mem);
+    libc::LibcContext::populateBridge(bridge.get());
+    DASHLE_ASSERT((bridge->registerFunction<dashle::BITS_32, &recurse>("recurse")));
+    DASHLE_ASSERT(bridge->buildIFT());
+
+    DASHLE_ASSERT_WRAPPER_CONST(qsortAddr, bridge->addressForSymbol("qsort"));
+    DASHLE_ASSERT_WRAPPER_CONST(recurseAddr, bridge->addressForSymbol("recurse"));
+    const auto callQsort = loadCode(*mem, trampoline(qsortAddr));
+    const auto callRecurse = loadCode(*mem, trampoline(recurseAddr));
+    const auto compare = loadCode(*mem, COMPARE_CODE);
+    const auto stack = mem->allocate({ .size = STACK_SIZE, .alignment = sizeof(u64) });
+    const auto elements = mem->allocate({ .size = NUM_ELEMENTS * sizeof(u32), .alignment = sizeof(u32) });
+    if (!callQsort || !callRecurse || !compare || !stack || !elements) {
+        TEST_FAILED("Could not set up the code!");
+    }
+
+    // Scrambled values, each one once.
+    std::array<u32, NUM_ELEMENTS> values;
+    for (auto i = 0u; i < NUM_ELEMENTS; ++i)
+        values[i] = (i * 37u) % NUM_ELEMENTS;
+
+    const auto base = elements.value()->virtualBase;
+    DASHLE_ASSERT(mem->write(base, values.data(), sizeof(values)));
+
+    guest::arm::ARMVM vm(mem, bridge, GuestVersion::Armeabi_v7a);
+    vm.setStackPointer(stack.value()->virtualBase + STACK_SIZE);
+    vm.setArgument(0u, base);
+    vm.setArgument(1u, NUM_ELEMENTS);
+    vm.setArgument(2u, sizeof(u32));
+    vm.setArgument(3u, compare.value());
+    if (vm.execute(callQsort.value()) != guest::VM_EXEC_SUCCESS) {
+        TEST_FAILED("Sort failed!");
+    }
+
+    std::array<u32, NUM_ELEMENTS> sorted;
+    DASHLE_ASSERT(mem->read(base, sorted.data(), sizeof(sorted)));
+    for (auto i = 0u; i < NUM_ELEMENTS; ++i) {
+        if (sorted[i] != i) {
+            TEST_FAILED(DASHLE_FORMAT("Wrong element {}: {}", i, sorted[i]));
+        }
+    }
+
+    // The first level runs from execute(), every other one fails once MAX_CALL_DEPTH calls are nested.
+    vm.setArgument(0u, callRecurse.value());
+    if (vm.execute(callRecurse.value()) != guest::VM_EXEC_SUCCESS || vm.returnValue() != guest::MAX_CALL_DEPTH - 1u) {
+        TEST_FAILED(DASHLE_FORMAT("Calls nested {} times!", vm.returnValue()));
+    }
+
+    TEST_PASSED();
+}
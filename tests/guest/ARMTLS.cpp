@@ -0,0 +1,64 @@
+#include "DasHLE/Guest/ARM/ARM.h"
+#include "Test.h"
+
+namespace guest = dashle::guest;
+namespace memory = dashle::host::memory;
+
+constexpr static u32 KEY_OFFSET = guest::TLS_FIRST_KEY * sizeof(u32);
+
+// Store a value in the first key slot.
+constexpr static u32 WRITE_CODE[] = {
+    0xEE1D0F70,              // mrc p15, 0, r0, c13, c0, 3 (TPIDRURO)
+    0xE3A01055,              // mov r1, #0x55
+    0xE5801000 | KEY_OFFSET, // str r1, [r0, #KEY_OFFSET]
+    0xE12FFF1E,              // bx lr
+};
+
+// Return 0 if the first slot points to itself and the first key slot is clear.
+constexpr static u32 READ_CODE[] = {
+    0xEE1D0F70,              // mrc p15, 0, r0, c13, c0, 3 (TPIDRURO)
+    0xE5901000,              // ldr r1, [r0]
+    0xE5902000 | KEY_OFFSET, // ldr r2, [r0, #KEY_OFFSET]
+    0xE0411000,              // sub r1, r1, r0
+    0xE1810002,              // orr r0, r1, r2
+    0xE12FFF1E,              // bx lr
+};
+
+static Expected<uaddr> loadCode(memory::MemoryManager& mem, std::span<const u32> code) {
+    DASHLE_TRY_EXPECTED_CONST(block, mem.allocate({ .size = code.size_bytes(), .alignment = sizeof(u32) }));
+    DASHLE_TRY_EXPECTED_VOID(mem.write(block->virtualBase, code.data(), code.size_bytes()));
+    DASHLE_TRY_EXPECTED_VOID(mem.setFlags(block->virtualBase, memory::flags::PERM_READ | memory::flags::PERM_EXEC));
+    return block->virtualBase;
+}
+
+// Dirty the TLS of a VM, then make sure the next VM reusing its memory starts with clear slots.
+DASHLE_TEST(Guest::ARMTLS) {
+    auto mem = std::make_shared<memory::MemoryManager>(std::make_unique<memory::MappedAllocator>(), 1u << 30);
+    auto bridge = std::make_shared<dashle::host::bridge::Bridge>(mem, dashle::BITS_32);
+
+    const auto writeCode = loadCode(*mem, WRITE_CODE);
+    const auto readCode = loadCode(*mem, READ_CODE);
+    if (!writeCode || !readCode) {
+        TEST_FAILED("Could not set up the code!");
+    }
+
+    uaddr oldTLSBase = 0u;
+    {
+        guest::arm::ARMVM vm(mem, bridge, GuestVersion::Armeabi_v7a, {});
+        oldTLSBase = vm.tlsBase();
+        if (vm.execute(writeCode.value()) != guest::VM_EXEC_SUCCESS || vm.returnValue() != oldTLSBase) {
+            TEST_FAILED("Wrong thread pointer!");
+        }
+    }
+
+    guest::arm::ARMVM vm(mem, bridge, GuestVersion::Armeabi_v7a, {});
+    if (vm.tlsBase() != oldTLSBase) {
+        TEST_FAILED("TLS memory was not reused!");
+    }
+
+    if (vm.execute(readCode.value()) != guest::VM_EXEC_SUCCESS || vm.returnValue()) {
+        TEST_FAILED(DASHLE_FORMAT("TLS was not cleared (result=0x{:X})!", vm.returnValue()));
+    }
+
+    TEST_PASSED();
+}
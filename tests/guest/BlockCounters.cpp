@@ -0,0 +1,58 @@
+#include "DasHLE/Guest/Profiler.h"
+#include "Test.h"
+
+#include <thread>
+
+namespace guest = dashle::guest;
+
+constexpr static usize NUM_ITERATIONS = 1000u;
+
+// Count blocks on several tables, then make sure they are merged and mapped to their functions.
+DASHLE_TEST(Guest::BlockCounters) {
+    guest::Symbolizer symbols;
+    symbols.add("main", 0x1000, 0x100);
+    symbols.add("loop", 0x2000, 0x40);
+
+    guest::BlockCounters counters;
+    auto first = counters.createTable();
+    auto second = counters.createTable();
+
+    // Blocks are counted on the threads running them, like VMs do.
+    std::thread thread([&] {
+        const auto body = second->counter(0x2011); // Thumb
+        for (auto i = 0u; i < NUM_ITERATIONS; ++i)
+            ++*body;
+    });
+
+    const auto entry = first->counter(0x1000);
+    const auto body = first->counter(0x2011);
+    ++*entry;
+    for (auto i = 0u; i < NUM_ITERATIONS; ++i)
+        ++*body;
+
+    ++*first->counter(0x500);
+    ++*first->counter(0x500);
+    thread.join();
+
+    // Tables outlive the VMs using them.
+    second.reset();
+
+    const auto blocks = counters.blocks();
+    if (blocks.size() != 3u || blocks[0].addr != 0x2011 || blocks[0].count != 2u * NUM_ITERATIONS
+        || blocks[1].addr != 0x500 || blocks[2].addr != 0x1000 || blocks[2].count != 1u) {
+        TEST_FAILED("Wrong block counts!");
+    }
+
+    const auto expected = DASHLE_FORMAT("0x2011 loop+0x10 {}\n0x500 ? 2\n", 2u * NUM_ITERATIONS);
+    if (counters.report(symbols, 2u) != expected) {
+        TEST_FAILED("Wrong report!");
+    }
+
+    // Counters stay in place, so compiled code can keep using them.
+    counters.reset();
+    if (!counters.blocks().empty() || first->counter(0x1000) != entry) {
+        TEST_FAILED("Counters were not reset!");
+    }
+
+    TEST_PASSED();
+}
@@ -0,0 +1,84 @@
+#include "DasHLE/Guest/VM.h"
+#include "Test.h"
+
+#include <atomic>
+#include <thread>
+
+namespace guest = dashle::guest;
+
+constexpr static usize MIN_SAMPLES = 10u;
+
+// Stacks are leaf first, callers are return addresses.
+constexpr static uaddr STACK_HOT[] = { 0x3004, 0x2010, 0x1020 }; // leaf <- work <- main
+constexpr static uaddr STACK_TAIL[] = { 0x2040, 0x1100 };        // work <- main, which ends with the call
+constexpr static uaddr STACK_UNKNOWN[] = { 0x500 };
+
+// Records a fixed stack when interrupted, from the thread running it like real VMs.
+class FakeVM final : public guest::VM {
+    std::atomic<bool> m_Interrupted = false;
+
+public:
+    bool takeInterrupt() { return m_Interrupted.exchange(false); }
+
+    dynarmic::HaltReason execute(Optional<uaddr> addr) override { return guest::VM_EXEC_SUCCESS; }
+    dynarmic::HaltReason step(Optional<uaddr> addr) override { return execute(addr); }
+    void halt(dynarmic::HaltReason reason) override {}
+    void interrupt(dynarmic::HaltReason reason) override { m_Interrupted = dynarmic::Has(reason, guest::halt::SAMPLE); }
+    void clearCache() override {}
+    void invalidateCache(uaddr addr, usize size) override {}
+    usize numRegisters() const override { return 0u; }
+    void setRegister(usize id, u64 value) override {}
+    u64 getRegister(usize id) const override { return 0u; }
+    void setStackPointer(uaddr sp) override {}
+    void setArgument(usize index, u64 value) override {}
+    u64 returnValue() const override { return 0u; }
+    Expected<u64> callFunction(uaddr addr, std::span<const u64> args) override { return Unexpected(Error::InvalidOperation); }
+    uaddr tlsBase() const override { return 0u; }
+};
+
+// Sample a VM, then make sure stacks are symbolized and merged.
+DASHLE_TEST(Guest::Profiler) {
+    guest::Symbolizer symbols;
+    symbols.add("work", 0x2000, 0x80);
+    symbols.add("main", 0x1000, 0x100);
+    symbols.add("leaf", 0x3000, 0u);
+
+    if (symbols.symbolize(0x1100) || symbols.symbolize(0x500) || symbols.symbolize(0x2050) != "work"
+        || symbols.symbolize(0x3FFF) != "leaf" || symbols.describe(0x500) != "0x500") {
+        TEST_FAILED("Wrong symbolization!");
+    }
+
+    auto profiler = std::make_shared<guest::Profiler>(std::chrono::microseconds(500));
+    FakeVM vm;
+    profiler->attach(&vm);
+    profiler->start();
+
+    usize hot = 0u;
+    while (hot < MIN_SAMPLES) {
+        if (vm.takeInterrupt()) {
+            profiler->record(STACK_HOT);
+            ++hot;
+        }
+
+        std::this_thread::yield();
+    }
+
+    profiler->stop();
+    profiler->detach(&vm);
+
+    profiler->record(STACK_TAIL);
+    profiler->record(STACK_TAIL);
+    profiler->record(STACK_UNKNOWN);
+
+    const auto expected = DASHLE_FORMAT("0x500 1\nmain;work 2\nmain;work;leaf {}\n", hot);
+    if (profiler->samples() != hot + 3u || profiler->folded(symbols) != expected) {
+        TEST_FAILED("Wrong folded stacks!");
+    }
+
+    profiler->reset();
+    if (profiler->samples() || !profiler->folded(symbols).empty()) {
+        TEST_FAILED("Samples were not reset!");
+    }
+
+    TEST_PASSED();
+}
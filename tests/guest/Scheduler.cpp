@@ -0,0 +1,95 @@
+#include "DasHLE/Guest/Scheduler.h"
+#include "DasHLE/Host/Sync.h"
+#include "Test.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace guest = dashle::guest;
+
+constexpr static usize NUM_SLOTS = 2u;
+constexpr static usize NUM_THREADS = 8u;
+constexpr static usize NUM_ITERATIONS = 10000u;
+constexpr static u64 QUANTUM = 1000u;
+
+// Make sure threads never run past the slot budget, and that blocked threads hand their slot over.
+DASHLE_TEST(Guest::Scheduler) {
+    guest::Scheduler scheduler(NUM_SLOTS, QUANTUM);
+
+    // Threads take turns.
+    std::atomic<usize> running = 0u;
+    std::atomic<usize> maxRunning = 0u;
+    std::atomic<usize> done = 0u;
+    std::vector<std::thread> threads;
+    for (auto i = 0u; i < NUM_THREADS; ++i) {
+        threads.emplace_back([&] {
+            guest::Scheduler::Slot slot(&scheduler);
+            for (auto j = 0u; j < NUM_ITERATIONS; ++j) {
+                const auto now = ++running;
+                auto max = maxRunning.load();
+                while (now > max && !maxRunning.compare_exchange_weak(max, now));
+                --running;
+
+                if (!(j % 100u))
+                    scheduler.yield();
+            }
+            ++done;
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    if (done != NUM_THREADS || maxRunning > NUM_SLOTS || scheduler.running()) {
+        TEST_FAILED("Threads ran past the slot budget!");
+    }
+
+    // A thread waiting on a semaphore lets the one which posts it run, even with a single slot.
+    guest::Scheduler single(1u, QUANTUM);
+    u32 sem = 0u;
+    std::atomic<bool> waiting = false;
+    host::sync::semInit(sem, 0u);
+    std::thread waiter([&] {
+        guest::Scheduler::Slot slot(&single);
+        waiting = true;
+        host::sync::semWait(sem);
+    });
+
+    while (!waiting)
+        std::this_thread::yield();
+
+    std::thread poster([&] {
+        guest::Scheduler::Slot slot(&single);
+        DASHLE_ASSERT(host::sync::semPost(sem));
+    });
+
+    poster.join();
+    waiter.join();
+
+    // Same for explicitly blocking host functions.
+    std::atomic<bool> blocking = false;
+    std::atomic<bool> released = false;
+    std::thread blocked([&] {
+        guest::Scheduler::Slot slot(&single);
+        guest::Scheduler::Blocking scope;
+        blocking = true;
+        while (!released)
+            std::this_thread::yield();
+    });
+
+    while (!blocking)
+        std::this_thread::yield();
+
+    {
+        guest::Scheduler::Slot slot(&single);
+        released = true;
+    }
+
+    blocked.join();
+    if (single.running()) {
+        TEST_FAILED("Slots were not released!");
+    }
+
+    TEST_PASSED();
+}
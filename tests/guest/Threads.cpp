@@ -0,0 +1,147 @@
+#include "DasHLE/Guest/Threads.h"
+#include "Test.h"
+
+#include <atomic>
+#include <set>
+#include <thread>
+
+namespace guest = dashle::guest;
+namespace memory = dashle::host::memory;
+
+constexpr static usize MAX_THREADS = 8u;
+constexpr static usize STACK_SIZE = 0x10000;
+constexpr static usize PAGE_SIZE = 0x1000;
+
+constexpr static uaddr ENTRY_SQUARE = 0x1000; // Return arg * arg.
+constexpr static uaddr ENTRY_BLOCK = 0x2000;  // Spin until released.
+
+static std::atomic<bool> g_Release = false;
+static std::atomic<usize> g_BadStacks = 0u;
+static std::atomic<usize> g_BadSlots = 0u;
+
+// Runs host code in place of guest code.
+class FakeVM final : public guest::VM {
+    std::shared_ptr<memory::MemoryManager> m_Mem;
+    usize m_Slot = 0u;
+    uaddr m_SP = 0u;
+    u64 m_R0 = 0u;
+
+public:
+    FakeVM(std::shared_ptr<memory::MemoryManager> mem, usize slot) : m_Mem(mem), m_Slot(slot) {}
+
+    dynarmic::HaltReason execute(Optional<uaddr> addr) override {
+        // The stack must be the top of a writable block owned by this thread only.
+        const auto block = m_Mem->blockFromVAddr(m_SP - 1u);
+        if (!block || block->virtualBase + block->size != m_SP || !(block->flags & memory::flags::PERM_WRITE))
+            ++g_BadStacks;
+
+        if (guest::ThreadManager::currentSlot() != m_Slot)
+            ++g_BadSlots;
+
+        if (addr == ENTRY_BLOCK) {
+            while (!g_Release)
+                std::this_thread::yield();
+        } else {
+            m_R0 *= m_R0;
+        }
+
+        return guest::VM_EXEC_SUCCESS;
+    }
+
+    dynarmic::HaltReason step(Optional<uaddr> addr) override { return execute(addr); }
+    void halt(dynarmic::HaltReason reason) override {}
+    void clearCache() override {}
+    void invalidateCache(uaddr addr, usize size) override {}
+    usize numRegisters() const override { return 0u; }
+    void setRegister(usize id, u64 value) override {}
+    u64 getRegister(usize id) const override { return 0u; }
+    void setStackPointer(uaddr sp) override { m_SP = sp; }
+    void setArgument(usize index, u64 value) override { m_R0 = value; }
+    u64 returnValue() const override { return m_R0; }
+    Expected<u64> callFunction(uaddr addr, std::span<const u64> args) override { return Unexpected(Error::InvalidOperation); }
+    uaddr tlsBase() const override { return 0u; }
+};
+
+// Run threads in parallel, and make sure slots and stacks are recycled.
+DASHLE_TEST(Guest::Threads) {
+    auto mem = std::make_shared<memory::MemoryManager>(std::make_unique<memory::MappedAllocator>(), 1u << 28);
+    std::set<usize> slots;
+    guest::ThreadManager threads(mem, [&mem, &slots](usize processorId) {
+        slots.insert(processorId);
+        return std::make_unique<FakeVM>(mem, processorId);
+    }, MAX_THREADS, STACK_SIZE, PAGE_SIZE);
+
+    if (guest::ThreadManager::currentId() != guest::MAIN_THREAD_ID || guest::ThreadManager::currentSlot()) {
+        TEST_FAILED("Wrong main thread id!");
+    }
+
+    // Fill every slot, the main thread owns the first one.
+    std::vector<u32> blocked;
+    for (auto i = 1u; i < MAX_THREADS; ++i) {
+        const auto id = threads.create(ENTRY_BLOCK, 0u);
+        if (!id) {
+            TEST_FAILED("Could not create thread!");
+        }
+
+        blocked.push_back(id.value());
+    }
+
+    if (threads.create(ENTRY_SQUARE, 0u) || slots.contains(0u) || slots.size() != MAX_THREADS - 1u) {
+        TEST_FAILED("Slots were not handed out correctly!");
+    }
+
+    if (mem->usedMemory() != (MAX_THREADS - 1u) * STACK_SIZE) {
+        TEST_FAILED("Stacks were not allocated!");
+    }
+
+    // Detached threads release their resources on exit.
+    if (!threads.detach(blocked[0]) || threads.join(blocked[0])) {
+        TEST_FAILED("Could not detach thread!");
+    }
+
+    g_Release = true;
+    for (auto i = 1u; i < blocked.size(); ++i) {
+        if (threads.join(blocked[i]).value_or(1u)) {
+            TEST_FAILED("Could not join thread!");
+        }
+    }
+
+    if (threads.join(blocked[1])) {
+        TEST_FAILED("Joined thread twice!");
+    }
+
+    // Slots free up again.
+    for (auto round = 0u; round < 4u; ++round) {
+        std::vector<std::pair<u32, u64>> squares;
+        for (auto i = 1u; i < MAX_THREADS; ++i) {
+            const auto arg = round * MAX_THREADS + i;
+            const auto id = threads.create(ENTRY_SQUARE, arg);
+            if (!id) {
+                TEST_FAILED("Slot was not released!");
+            }
+
+            squares.emplace_back(id.value(), arg * arg);
+        }
+
+        for (const auto& [id, expected] : squares) {
+            if (threads.join(id).value_or(0u) != expected) {
+                TEST_FAILED("Wrong thread result!");
+            }
+        }
+    }
+
+    threads.waitAll();
+    if (mem->usedMemory()) {
+        TEST_FAILED("Stacks were not freed!");
+    }
+
+    if (g_BadStacks) {
+        TEST_FAILED("Threads ran on invalid stacks!");
+    }
+
+    if (g_BadSlots) {
+        TEST_FAILED("Threads ran with the wrong slot!");
+    }
+
+    TEST_PASSED();
+}
@@ -1,11 +1,13 @@
-#include "Memory.h"
+#include "DasHLE/Host/Memory.h"
 #include "Test.h"
 
+namespace memory = dashle::host::memory;
+
 // Test the implementation of allocate().
 DASHLE_TEST(Memory::Allocate) {
     memory::MemoryManager mem(std::make_unique<memory::HostAllocator>(), static_cast<u32>(-1));
 
-    auto ret = mem.allocate(0u);
+    auto ret = mem.allocate({ .size = 0u });
     if (ret) {
         TEST_FAILED("Allocate did not return an error with size = 0!");
     }
@@ -14,22 +16,22 @@ DASHLE_TEST(Memory::Allocate) {
         TEST_FAILED(std::format("Allocate returned the wrong error code with size = 0: {}", errorAsString(ret.error())));
     }
 
-    const auto flags = rand();
-    ret = mem.allocate(mem.maxMemory(), flags);
+    const auto flags = static_cast<usize>(rand());
+    ret = mem.allocate({ .size = mem.maxMemory(), .flags = flags });
     if (!ret) {
         TEST_FAILED(std::format("Allocation failed: {}", errorAsString(ret.error())));
     }
 
-    auto block = mem.blockFromVAddr(ret.value());
+    auto block = mem.blockFromVAddr(ret.value()->virtualBase);
     if (!block) {
         TEST_FAILED(std::format("Could not find the allocated block: {}", errorAsString(block.error())));
     }
 
-    if (block.value()->flags != (flags & memory::MemoryManager::FLAG_MASK)) {
+    if ((block->flags & memory::flags::PERM_MASK) != (flags & memory::flags::PERM_MASK)) {
         TEST_FAILED("Flags mismatch!");
     }
 
-    ret = mem.allocate(1);
+    ret = mem.allocate({ .size = 1u });
     if (ret) {
         TEST_FAILED("Allocation shall not succeed with no memory available!");
     }
@@ -0,0 +1,106 @@
+#include "DasHLE/Host/Memory.h"
+#include "Test.h"
+
+#include <cstring>
+#include <vector>
+
+namespace memory = dashle::host::memory;
+
+constexpr static usize BLOCK_SIZE = 0x1000;
+constexpr static usize NUM_BLOCKS = 16u;
+constexpr static usize SPACE_SIZE = BLOCK_SIZE * NUM_BLOCKS;
+
+// Test bulk operations on ranges spanning several blocks, against a flat reference buffer.
+DASHLE_TEST(Memory::Bulk) {
+    memory::MemoryManager mem(std::make_unique<memory::HostAllocator>(), 1u << 24);
+
+    // Contiguous blocks, allocated separately so that they have distinct host memory.
+    std::vector<uaddr> blocks;
+    for (auto i = 0u; i < NUM_BLOCKS; ++i) {
+        const auto ret = mem.allocate({
+            .size = BLOCK_SIZE,
+            .hint = BLOCK_SIZE + i * BLOCK_SIZE,
+            .flags = memory::flags::PERM_READ_WRITE | memory::flags::FORCE_HINT,
+        });
+        if (!ret) {
+            TEST_FAILED(std::format("Allocation failed: {}", errorAsString(ret.error())));
+        }
+
+        blocks.push_back(ret.value()->virtualBase);
+    }
+
+    const auto base = blocks[0];
+    std::vector<u8> reference(SPACE_SIZE);
+    std::vector<u8> buffer(SPACE_SIZE);
+    for (auto& byte : reference)
+        byte = static_cast<u8>(rand());
+
+    if (!mem.write(base, reference.data(), SPACE_SIZE)) {
+        TEST_FAILED("Write failed!");
+    }
+
+    for (auto i = 0u; i < 10000; ++i) {
+        const auto offset = randomSize<0, SPACE_SIZE>();
+        const auto size = randomSize<0, SPACE_SIZE>() % (SPACE_SIZE - offset);
+        const auto otherOffset = randomSize<0, SPACE_SIZE - BLOCK_SIZE * 2>() % (SPACE_SIZE - size);
+
+        switch (rand() % 4) {
+            case 0: {
+                const auto value = static_cast<u8>(rand());
+                std::memset(reference.data() + offset, value, size);
+                if (!mem.fill(base + offset, value, size)) {
+                    TEST_FAILED("Fill failed!");
+                }
+                break;
+            }
+            case 1:
+                std::memmove(reference.data() + otherOffset, reference.data() + offset, size);
+                if (!mem.copy(base + otherOffset, base + offset, size)) {
+                    TEST_FAILED("Copy failed!");
+                }
+                break;
+            case 2: {
+                const auto expected = std::memcmp(reference.data() + offset, reference.data() + otherOffset, size);
+                const auto ret = mem.compare(base + offset, base + otherOffset, size);
+                if (!ret || (ret.value() < 0) != (expected < 0) || (ret.value() > 0) != (expected > 0)) {
+                    TEST_FAILED("Compare mismatch!");
+                }
+                break;
+            }
+            case 3: {
+                const auto value = static_cast<u8>(rand());
+                const auto ptr = std::memchr(reference.data() + offset, value, size);
+                const auto ret = mem.find(base + offset, value, size);
+                const auto expected = ptr ? Optional<uaddr>(base + (static_cast<const u8*>(ptr) - reference.data())) : Optional<uaddr>();
+                if (!ret || ret.value() != expected) {
+                    TEST_FAILED("Find mismatch!");
+                }
+                break;
+            }
+        }
+    }
+
+    if (!mem.read(base, buffer.data(), SPACE_SIZE) || buffer != reference) {
+        TEST_FAILED("Contents don't match the reference!");
+    }
+
+    // Permissions are checked for every block in the range.
+    if (!mem.setFlags(blocks[1], memory::flags::PERM_READ)) {
+        TEST_FAILED("Could not set flags!");
+    }
+
+    if (const auto ret = mem.fill(base, 0u, BLOCK_SIZE * 2); ret || ret.error() != Error::PermissionDenied) {
+        TEST_FAILED("Write to a read only block succeeded!");
+    }
+
+    // Gaps are not crossed.
+    if (!mem.free(blocks[NUM_BLOCKS - 2])) {
+        TEST_FAILED("Free failed!");
+    }
+
+    if (const auto ret = mem.read(blocks[NUM_BLOCKS - 3], buffer.data(), BLOCK_SIZE * 3); ret || ret.error() != Error::NotFound) {
+        TEST_FAILED("Read across a gap succeeded!");
+    }
+
+    TEST_PASSED();
+}
@@ -0,0 +1,87 @@
+#include "DasHLE/Host/Memory.h"
+#include "Test.h"
+
+namespace memory = dashle::host::memory;
+
+class DummyAllocator : public memory::HostAllocator {
+    bool alloc(memory::AllocatedBlock& block) { return true; }
+    void free(memory::AllocatedBlock& block) {}
+};
+
+constexpr static usize BLOCK_SIZE = 0x1000;
+constexpr static usize NUM_HINTED_ALLOCS = 4096;
+
+struct Result {
+    double nsPerAlloc;
+    usize fragmentedFreeBlocks; // Once the hinted allocations are freed.
+    usize mergedFreeBlocks;     // Once everything is freed.
+};
+
+// Fragment the address space with numHoles free blocks, then time hinted allocations into them.
+static Expected<Result> measureHintedAlloc(usize numHoles) {
+    memory::MemoryManager mem(std::make_unique<DummyAllocator>(), static_cast<u32>(-1));
+
+    // Allocate contiguous blocks and free every other one.
+    std::vector<uaddr> holes;
+    std::vector<uaddr> blocks;
+    for (auto i = 0u; i < numHoles * 2; ++i) {
+        DASHLE_TRY_EXPECTED_CONST(block, mem.allocate({ .size = BLOCK_SIZE, .hint = i * BLOCK_SIZE }));
+        if (i & 1) {
+            holes.push_back(block->virtualBase);
+        } else {
+            blocks.push_back(block->virtualBase);
+        }
+    }
+
+    for (const auto vaddr : holes)
+        DASHLE_TRY_EXPECTED_VOID(mem.free(vaddr));
+
+    // Fill random holes with forced hints, then free them again.
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (auto i = 0u; i < NUM_HINTED_ALLOCS; ++i) {
+        const auto vaddr = holes[rand() % holes.size()];
+        DASHLE_TRY_EXPECTED_CONST(block, mem.allocate({
+            .size = BLOCK_SIZE,
+            .hint = vaddr,
+            .flags = memory::flags::PERM_READ_WRITE | memory::flags::FORCE_HINT
+        }));
+
+        if (block->virtualBase != vaddr)
+            return Unexpected(Error::InvalidAddress);
+
+        DASHLE_TRY_EXPECTED_VOID(mem.free(vaddr));
+    }
+    const auto elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    Result result;
+    result.nsPerAlloc = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / NUM_HINTED_ALLOCS;
+    result.fragmentedFreeBlocks = mem.numFreeBlocks();
+
+    for (const auto vaddr : blocks)
+        DASHLE_TRY_EXPECTED_VOID(mem.free(vaddr));
+
+    result.mergedFreeBlocks = mem.numFreeBlocks();
+    return result;
+}
+
+// Make sure hinted allocations split and merge free blocks exactly, whatever the fragmentation.
+DASHLE_TEST(Memory::Fragmentation) {
+    constexpr usize LEVELS[] = { 1u << 8, 1u << 12, 1u << 16 };
+
+    for (const auto numHoles : LEVELS) {
+        const auto ret = measureHintedAlloc(numHoles);
+        if (!ret) {
+            TEST_FAILED(std::format("Hinted allocation failed: {}", errorAsString(ret.error())));
+        }
+
+        DASHLE_LOG(std::format("{} free blocks: {:.1f}ns per hinted allocation", numHoles, ret->nsPerAlloc));
+
+        // The last hole merges with the rest of the address space.
+        if (ret->fragmentedFreeBlocks != numHoles || ret->mergedFreeBlocks != 1u) {
+            TEST_FAILED(std::format("Free blocks were not merged: {} with {} holes, {} once empty",
+                ret->fragmentedFreeBlocks, numHoles, ret->mergedFreeBlocks));
+        }
+    }
+
+    TEST_PASSED();
+}
@@ -1,13 +1,15 @@
-#include "Memory.h"
+#include "DasHLE/Host/Memory.h"
 #include "Test.h"
 
+namespace memory = dashle::host::memory;
+
 // Test the implementation of free.
 DASHLE_TEST(Memory::Free) {
     memory::MemoryManager mem(std::make_unique<memory::HostAllocator>(), static_cast<u32>(-1));
 
     while (true) {
         const auto size = randomSize<16, (1 << 16)>();
-        auto ret = mem.allocate(size);
+        auto ret = mem.allocate({ .size = size });
         if (!ret) {
             if (ret.error() == Error::NoVirtualMemory)
                 break;
@@ -16,7 +18,7 @@ DASHLE_TEST(Memory::Free) {
         }
 
         if (rand() & 1) {
-            if (auto freeRet = mem.free(ret.value()); !freeRet) {
+            if (auto freeRet = mem.free(ret.value()->virtualBase); !freeRet) {
                 TEST_FAILED(std::format("Free operation failed: %s", errorAsString(freeRet.error())));
             }
         }
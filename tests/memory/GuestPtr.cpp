@@ -0,0 +1,64 @@
+#include "DasHLE/Host/Memory.h"
+#include "DasHLE/Host/GuestPtr.h"
+#include "Test.h"
+
+namespace memory = dashle::host::memory;
+
+struct Pair {
+    u32 first;
+    u32 second;
+};
+
+// Test guest views translation, bounds and permission checks.
+DASHLE_TEST(Memory::GuestPtr) {
+    memory::MemoryManager mem(std::make_unique<memory::HostAllocator>(), 1u << 24);
+
+    const auto ret = mem.allocate({ .size = 0x100, .flags = memory::flags::PERM_READ_WRITE });
+    if (!ret) {
+        TEST_FAILED(std::format("Allocation failed: {}", errorAsString(ret.error())));
+    }
+
+    const auto vbase = ret.value()->virtualBase;
+    const auto span = memory::GuestSpan<Pair>::from(mem, vbase, 0x100 / sizeof(Pair));
+    if (!span || span->size() != 0x100 / sizeof(Pair)) {
+        TEST_FAILED("Could not create span!");
+    }
+
+    for (auto i = 0u; i < span->size(); ++i)
+        (*span)[i] = { .first = i, .second = ~i };
+
+    // Views share the same host memory.
+    const auto ptr = memory::GuestPtr<const Pair>::from(mem, span->vaddrOf(3));
+    if (!ptr || (*ptr)->first != 3 || (*ptr)->second != ~3u) {
+        TEST_FAILED("Pointer doesn't match the span!");
+    }
+
+    const auto addr = memory::GuestPtr<memory::GuestAddr<dashle::BITS_32>>::from(mem, vbase + 4u);
+    if (!addr || *addr.value() != ~0u) {
+        TEST_FAILED("32 bits pointer mismatch!");
+    }
+
+    // Views can't exceed the block.
+    if (const auto ret = memory::GuestSpan<u8>::from(mem, vbase + 1u, 0x100); ret || ret.error() != Error::InvalidSize) {
+        TEST_FAILED("Span exceeding the block was created!");
+    }
+
+    if (const auto ret = memory::GuestPtr<u64>::from(mem, vbase + 0xFC); ret || ret.error() != Error::InvalidSize) {
+        TEST_FAILED("Pointer exceeding the block was created!");
+    }
+
+    // Read only memory can only be viewed as const.
+    if (!mem.setFlags(vbase, memory::flags::PERM_READ)) {
+        TEST_FAILED("Could not set flags!");
+    }
+
+    if (const auto ret = memory::GuestPtr<u32>::from(mem, vbase); ret || ret.error() != Error::PermissionDenied) {
+        TEST_FAILED("Writable pointer to read only memory was created!");
+    }
+
+    if (!memory::GuestPtr<const u32>::from(mem, vbase)) {
+        TEST_FAILED("Could not create const pointer!");
+    }
+
+    TEST_PASSED();
+}
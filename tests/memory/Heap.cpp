@@ -0,0 +1,135 @@
+#include "DasHLE/Host/Memory.h"
+#include "DasHLE/Host/Heap.h"
+#include "Test.h"
+
+#include <cstring>
+#include <map>
+#include <thread>
+
+namespace memory = dashle::host::memory;
+namespace heap = dashle::host::heap;
+
+struct Allocation {
+    usize size;
+    u8 pattern;
+};
+
+static u8* hostPtr(memory::MemoryManager& mem, uaddr vaddr) {
+    const auto block = mem.blockFromVAddr(vaddr).value();
+    return reinterpret_cast<u8*>(memory::virtualToHost(block, vaddr).value());
+}
+
+static bool checkPattern(memory::MemoryManager& mem, uaddr vaddr, const Allocation& alloc) {
+    const auto ptr = hostPtr(mem, vaddr);
+    for (auto i = 0u; i < alloc.size; ++i) {
+        if (ptr[i] != alloc.pattern)
+            return false;
+    }
+
+    return true;
+}
+
+// Make sure heap allocations are aligned, don't overlap and keep their contents.
+DASHLE_TEST(Memory::Heap) {
+    auto mem = std::make_shared<memory::MemoryManager>(std::make_unique<memory::HostAllocator>(), 1u << 30);
+
+    // Address 0 is NULL for the guest.
+    if (!mem->allocate({ .size = 0x1000, .hint = 0u, .flags = memory::flags::FORCE_HINT })) {
+        TEST_FAILED("Could not reserve the null page!");
+    }
+
+    heap::GuestHeap guestHeap(mem);
+    std::map<uaddr, Allocation> allocations;
+
+    for (auto i = 0u; i < 100000; ++i) {
+        const auto op = rand() % 4;
+        if (op < 2 || allocations.empty()) {
+            const auto size = (rand() % 16) ? randomSize<1, 512>() : randomSize<512, 16384>();
+            const auto ret = (op == 1) ? guestHeap.allocateZeroed(1u, size) : guestHeap.allocate(size);
+            if (!ret) {
+                TEST_FAILED(std::format("Allocation failed: {}", errorAsString(ret.error())));
+            }
+
+            const auto vaddr = ret.value();
+            if (vaddr % heap::MIN_ALIGNMENT) {
+                TEST_FAILED("Misaligned allocation!");
+            }
+
+            if (guestHeap.usableSize(vaddr).value_or(0u) < size) {
+                TEST_FAILED("Allocation is too small!");
+            }
+
+            auto it = allocations.lower_bound(vaddr);
+            if ((it != allocations.end() && it->first < vaddr + size)
+                || (it != allocations.begin() && std::prev(it)->first + std::prev(it)->second.size > vaddr)) {
+                TEST_FAILED("Overlapping allocations!");
+            }
+
+            if (op == 1 && !checkPattern(*mem, vaddr, { .size = size, .pattern = 0u })) {
+                TEST_FAILED("Memory is not zeroed!");
+            }
+
+            const auto alloc = Allocation{ .size = size, .pattern = static_cast<u8>(rand()) };
+            std::memset(hostPtr(*mem, vaddr), alloc.pattern, size);
+            allocations[vaddr] = alloc;
+            continue;
+        }
+
+        auto it = allocations.begin();
+        std::advance(it, rand() % std::min<usize>(allocations.size(), 64u));
+        if (!checkPattern(*mem, it->first, it->second)) {
+            TEST_FAILED("Memory was corrupted!");
+        }
+
+        if (op == 2) {
+            // Shrink or grow, contents must be preserved.
+            auto alloc = it->second;
+            alloc.size = randomSize<1, 1024>();
+            const auto ret = guestHeap.reallocate(it->first, alloc.size);
+            if (!ret) {
+                TEST_FAILED(std::format("Reallocation failed: {}", errorAsString(ret.error())));
+            }
+
+            const auto preserved = Allocation{ .size = std::min(alloc.size, it->second.size), .pattern = it->second.pattern };
+            allocations.erase(it);
+            if (!checkPattern(*mem, ret.value(), preserved)) {
+                TEST_FAILED("Reallocation lost contents!");
+            }
+
+            std::memset(hostPtr(*mem, ret.value()), alloc.pattern, alloc.size);
+            allocations[ret.value()] = alloc;
+            continue;
+        }
+
+        if (!guestHeap.free(it->first)) {
+            TEST_FAILED("Free failed!");
+        }
+
+        allocations.erase(it);
+    }
+
+    // Addresses not returned by the heap must be rejected.
+    if (guestHeap.free(mem->maxMemory() - 16u)) {
+        TEST_FAILED("Freed an invalid address!");
+    }
+
+    // Objects cached by a thread go back to the heap when it exits.
+    heap::GuestHeap threadHeap(mem);
+    uaddr threadVAddr = 0u;
+    std::thread([&threadHeap, &threadVAddr] {
+        threadVAddr = threadHeap.allocate(48u).value_or(0u);
+        static_cast<void>(threadHeap.free(threadVAddr));
+    }).join();
+
+    const auto vaddr = threadHeap.allocate(48u);
+    if (!vaddr || vaddr.value() != threadVAddr) {
+        TEST_FAILED("Thread cache was not released!");
+    }
+
+    // Double frees and objects never handed out must be rejected.
+    if (!threadHeap.free(vaddr.value()) || threadHeap.free(vaddr.value()) || threadHeap.free(vaddr.value() + 5u * 48u)) {
+        TEST_FAILED("Freed an object which is not allocated!");
+    }
+
+    TEST_PASSED();
+}
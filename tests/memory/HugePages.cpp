@@ -0,0 +1,80 @@
+#include "DasHLE/Host/Memory.h"
+#include "Test.h"
+
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace memory = dashle::host::memory;
+
+constexpr static usize WORKING_SET = 256u * 1024 * 1024;
+constexpr static usize NUM_ACCESSES = 1u << 23;
+
+struct Result {
+    double nsPerAccess;
+    usize hugePages;
+};
+
+// Chase pointers across a big guest block, so that nearly every access misses the TLB.
+static Expected<Result> measure(memory::HugePages hugePages) {
+    auto allocator = std::make_unique<memory::MappedAllocator>(hugePages);
+    const auto mappedAllocator = allocator.get();
+    memory::MemoryManager mem(std::move(allocator), 1u << 30);
+
+    DASHLE_TRY_EXPECTED_CONST(block, mem.allocate({
+        .size = WORKING_SET,
+        .alignment = memory::HUGE_PAGE_SIZE,
+    }));
+
+    // A random cycle over one slot per cache line.
+    constexpr auto NUM_SLOTS = WORKING_SET / 64u;
+    std::vector<u32> order(NUM_SLOTS);
+    std::iota(order.begin(), order.end(), 0u);
+    std::shuffle(order.begin(), order.end(), std::mt19937(1234u));
+
+    const auto slots = reinterpret_cast<u32*>(block->hostBase);
+    for (auto i = 0u; i < NUM_SLOTS; ++i)
+        slots[order[i] * 16u] = order[(i + 1u) % NUM_SLOTS] * 16u;
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    u32 index = 0u;
+    for (auto i = 0u; i < NUM_ACCESSES; ++i)
+        index = slots[index];
+
+    const auto elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    // Keep the loop alive.
+    if (index >= WORKING_SET / sizeof(u32))
+        return Unexpected(Error::InvalidIndex);
+
+    const auto result = Result {
+        .nsPerAccess = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / NUM_ACCESSES,
+        .hugePages = mappedAllocator->hugePages(),
+    };
+
+    // Protecting and freeing must not cut through the huge pages.
+    const auto vbase = block->virtualBase;
+    DASHLE_TRY_EXPECTED_VOID(mem.setFlags(vbase, memory::flags::PERM_READ));
+    DASHLE_TRY_EXPECTED_VOID(mem.free(vbase));
+    return result;
+}
+
+// Compare TLB heavy accesses with and without huge pages. Hosts may not grant any, so this only reports.
+DASHLE_TEST(Memory::HugePages) {
+    constexpr std::pair<memory::HugePages, const char*> MODES[] = {
+        { memory::HugePages::None, "None" },
+        { memory::HugePages::Transparent, "Transparent" },
+        { memory::HugePages::Explicit, "Explicit" },
+    };
+
+    for (const auto& [mode, name] : MODES) {
+        const auto ret = measure(mode);
+        if (!ret) {
+            TEST_FAILED(std::format("{}: {}", name, errorAsString(ret.error())));
+        }
+
+        DASHLE_LOG(std::format("{}: {:.1f}ns per access, {} huge pages", name, ret->nsPerAccess, ret->hugePages));
+    }
+
+    TEST_PASSED();
+}
@@ -0,0 +1,57 @@
+#include "DasHLE/Host/Memory.h"
+#include "Test.h"
+
+namespace memory = dashle::host::memory;
+
+constexpr static usize RESERVED_SIZE = 64u * 1024 * 1024;
+constexpr static usize TOUCHED_SIZE = 4u * 1024 * 1024;
+constexpr static usize STRIDE = 0x10000;
+
+// Make sure resident memory follows touched pages rather than allocated ones.
+DASHLE_TEST(Memory::LazyCommit) {
+    memory::MemoryManager mem(std::make_unique<memory::MappedAllocator>(), 1u << 30);
+
+    const auto baseline = mem.residentMemory();
+    if (!baseline) {
+        TEST_FAILED("Resident memory not reported!");
+    }
+
+    const auto ret = mem.allocate({
+        .size = RESERVED_SIZE,
+        .flags = memory::flags::PERM_READ_WRITE | memory::flags::LAZY_COMMIT,
+    });
+    if (!ret) {
+        TEST_FAILED(std::format("Allocation failed: {}", errorAsString(ret.error())));
+    }
+
+    const auto vbase = ret.value()->virtualBase;
+    if (mem.residentMemory().value() - baseline.value() >= TOUCHED_SIZE / STRIDE * 0x1000) {
+        TEST_FAILED("Memory committed before being touched!");
+    }
+
+    // Touch one byte every STRIDE bytes, which commits a single page each.
+    for (auto offset = 0u; offset < TOUCHED_SIZE; offset += STRIDE) {
+        const u8 value = 1u;
+        if (!mem.write(vbase + offset, &value, 1u)) {
+            TEST_FAILED("Write failed!");
+        }
+    }
+
+    const auto resident = mem.residentMemory().value() - baseline.value();
+    if (resident < TOUCHED_SIZE / STRIDE * 0x1000 || resident >= TOUCHED_SIZE) {
+        TEST_FAILED(std::format("Unexpected resident memory: {} bytes", resident));
+    }
+
+    // Untouched memory reads as zero.
+    u8 value = 1u;
+    if (!mem.read(vbase + RESERVED_SIZE - 1u, &value, 1u) || value) {
+        TEST_FAILED("Untouched memory is not zero!");
+    }
+
+    // Flags other than permissions survive permission changes.
+    if (!mem.setFlags(vbase, memory::flags::PERM_READ) || !(mem.blockFromVAddr(vbase)->flags & memory::flags::LAZY_COMMIT)) {
+        TEST_FAILED("Lazy commit flag was dropped!");
+    }
+
+    TEST_PASSED();
+}
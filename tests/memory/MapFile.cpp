@@ -0,0 +1,111 @@
+#include "DasHLE/Host/Memory.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include <unistd.h>
+
+namespace memory = dashle::host::memory;
+
+constexpr static usize PAGE_SIZE = 0x1000;
+constexpr static usize FILE_SIZE = 16u * PAGE_SIZE;
+constexpr static usize MAP_OFFSET = 4u * PAGE_SIZE;
+constexpr static usize MAP_SIZE = 8u * PAGE_SIZE;
+
+static u8 filePattern(usize offset) { return static_cast<u8>(offset * 7u + (offset >> 12)); }
+
+static bool checkFile(int fd, usize offset, u8 expected) {
+    u8 value = 0u;
+    return pread(fd, &value, 1u, offset) == 1 && value == expected;
+}
+
+// Map a file privately and shared, and make sure writes only reach the file in the latter case.
+DASHLE_TEST(Memory::MapFile) {
+    const auto handle = std::tmpfile();
+    if (!handle) {
+        TEST_FAILED("Could not create file!");
+    }
+
+    const auto fd = fileno(handle);
+    std::vector<u8> contents(FILE_SIZE);
+    for (auto i = 0u; i < FILE_SIZE; ++i)
+        contents[i] = filePattern(i);
+
+    if (pwrite(fd, contents.data(), contents.size(), 0) != static_cast<ssize_t>(contents.size())) {
+        TEST_FAILED("Could not write file!");
+    }
+
+    memory::MemoryManager mem(std::make_unique<memory::MappedAllocator>(), 1u << 28);
+    const memory::AllocArgs args = { .size = MAP_SIZE, .alignment = PAGE_SIZE };
+
+    // Private mappings see the file, writes stay in the guest.
+    const auto priv = mem.mapFile(args, { .fd = fd, .offset = MAP_OFFSET });
+    if (!priv) {
+        TEST_FAILED(std::format("Private mapping failed: {}", errorAsString(priv.error())));
+    }
+
+    const auto privVAddr = priv.value()->virtualBase;
+    std::vector<u8> buffer(MAP_SIZE);
+    if (!mem.read(privVAddr, buffer.data(), buffer.size()) || !std::equal(buffer.begin(), buffer.end(), contents.begin() + MAP_OFFSET)) {
+        TEST_FAILED("Private mapping doesn't match the file!");
+    }
+
+    if (!mem.fill(privVAddr, 0xAA, PAGE_SIZE) || !checkFile(fd, MAP_OFFSET, filePattern(MAP_OFFSET))) {
+        TEST_FAILED("Private writes reached the file!");
+    }
+
+    // Shared mappings write through.
+    const auto shared = mem.mapFile(args, { .fd = fd, .offset = MAP_OFFSET, .shared = true });
+    if (!shared) {
+        TEST_FAILED(std::format("Shared mapping failed: {}", errorAsString(shared.error())));
+    }
+
+    const auto sharedVAddr = shared.value()->virtualBase;
+    if (!mem.fill(sharedVAddr + PAGE_SIZE, 0x55, PAGE_SIZE) || !checkFile(fd, MAP_OFFSET + PAGE_SIZE, 0x55)) {
+        TEST_FAILED("Shared writes didn't reach the file!");
+    }
+
+    u8 value = 0u;
+    if (!mem.read(privVAddr + PAGE_SIZE + 1u, &value, 1u) || value != 0x55) {
+        TEST_FAILED("Untouched private pages don't follow the file!");
+    }
+
+    // Permissions apply to mapped files too.
+    if (!mem.setFlags(sharedVAddr, memory::flags::PERM_READ) || mem.fill(sharedVAddr, 0u, 1u)) {
+        TEST_FAILED("Read only mapping was written to!");
+    }
+
+    // Freed ranges go back to fresh memory.
+    if (!mem.free(sharedVAddr) || !mem.free(privVAddr)) {
+        TEST_FAILED("Free failed!");
+    }
+
+    const auto fresh = mem.allocate({ .size = MAP_SIZE, .hint = privVAddr, .flags = memory::flags::PERM_READ_WRITE | memory::flags::FORCE_HINT });
+    if (!fresh || !mem.read(privVAddr, buffer.data(), buffer.size()) || std::any_of(buffer.begin(), buffer.end(), [](u8 v) { return v; })) {
+        TEST_FAILED("Fresh memory is not zeroed!");
+    }
+
+    // Unaligned offsets, sizes and bad descriptors are rejected.
+    const auto unalignedOffset = mem.mapFile(args, { .fd = fd, .offset = 1u });
+    const auto unalignedSize = mem.mapFile({ .size = PAGE_SIZE + 1u }, { .fd = fd });
+    if (unalignedOffset || unalignedOffset.error() != Error::InvalidAlignment ||
+        unalignedSize || unalignedSize.error() != Error::InvalidAlignment || mem.mapFile(args, {})) {
+        TEST_FAILED("Invalid mapping succeeded!");
+    }
+
+    // Ranges past the end of the file are rejected rather than faulting when touched.
+    const auto pastEnd = mem.mapFile(args, { .fd = fd, .offset = FILE_SIZE - MAP_SIZE + PAGE_SIZE });
+    if (pastEnd || pastEnd.error() != Error::InvalidArgument) {
+        TEST_FAILED("Mapping past the end of the file succeeded!");
+    }
+
+    // Allocators which can't map files fail cleanly.
+    memory::MemoryManager generic(std::make_unique<memory::HostAllocator>(), 1u << 28);
+    if (generic.mapFile(args, { .fd = fd }) || generic.usedMemory()) {
+        TEST_FAILED("Generic allocator mapped a file!");
+    }
+
+    std::fclose(handle);
+    TEST_PASSED();
+}
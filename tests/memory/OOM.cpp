@@ -1,6 +1,8 @@
-#include "Memory.h"
+#include "DasHLE/Host/Memory.h"
 #include "Test.h"
 
+namespace memory = dashle::host::memory;
+
 class DummyAllocator : public memory::HostAllocator {
     bool alloc(memory::AllocatedBlock& block) { return true; }
     void free(memory::AllocatedBlock& block) {}
@@ -13,7 +15,7 @@ DASHLE_TEST(Memory::OOM) {
     usize allocatedBytes = 0;
     while (true) {
         const auto size = randomSize<16, 32>();
-        if (!mem.allocate(size))
+        if (!mem.allocate({ .size = size }))
             break;
 
         allocatedBytes += size;
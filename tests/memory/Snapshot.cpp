@@ -0,0 +1,148 @@
+#include "DasHLE/Host/Memory.h"
+#include "DasHLE/Host/Heap.h"
+#include "Test.h"
+
+#include <cstring>
+#include <vector>
+
+namespace memory = dashle::host::memory;
+namespace heap = dashle::host::heap;
+
+constexpr static usize MEMORY_SIZE = 1u << 28;
+constexpr static usize NUM_BLOCKS = 256u;
+
+struct Block {
+    uaddr vaddr;
+    usize size;
+    u8 pattern;
+};
+
+static u8* hostPtr(memory::MemoryManager& mem, uaddr vaddr) {
+    const auto block = mem.blockFromVAddr(vaddr).value();
+    return reinterpret_cast<u8*>(memory::virtualToHost(block, vaddr).value());
+}
+
+static bool checkBlocks(memory::MemoryManager& mem, const std::vector<Block>& blocks) {
+    for (const auto& block : blocks) {
+        const auto ret = mem.blockFromVAddr(block.vaddr);
+        if (!ret || ret->virtualBase != block.vaddr || ret->size != block.size)
+            return false;
+
+        const auto ptr = hostPtr(mem, block.vaddr);
+        for (auto i = 0u; i < block.size; ++i) {
+            if (ptr[i] != block.pattern)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static const char* testAllocator(std::unique_ptr<memory::HostAllocator> allocator, std::unique_ptr<memory::HostAllocator> forkAllocator, bool zeroed) {
+    auto mem = std::make_shared<memory::MemoryManager>(std::move(allocator), MEMORY_SIZE);
+    if (!mem->allocate({ .size = 0x1000, .hint = 0u, .flags = memory::flags::FORCE_HINT }))
+        return "Could not reserve the null page!";
+
+    heap::GuestHeap guestHeap(mem);
+
+    std::vector<Block> blocks;
+    for (auto i = 0u; i < NUM_BLOCKS; ++i) {
+        const auto size = randomSize<1, 0x4000>();
+        const auto ret = mem->allocate({ .size = size });
+        if (!ret)
+            return "Allocation failed!";
+
+        const Block block = { .vaddr = ret.value()->virtualBase, .size = size, .pattern = static_cast<u8>(rand()) };
+        std::memset(hostPtr(*mem, block.vaddr), block.pattern, size);
+        blocks.push_back(block);
+    }
+
+    std::vector<uaddr> heapObjects;
+    for (auto i = 0u; i < NUM_BLOCKS; ++i)
+        heapObjects.push_back(guestHeap.allocate(randomSize<1, 256>()).value());
+
+    // Read only blocks must be captured too.
+    if (!mem->setFlags(blocks[0].vaddr, memory::flags::PERM_READ))
+        return "Could not set flags!";
+
+    const auto usedMemory = mem->usedMemory();
+    const auto memSnapshot = mem->snapshot();
+    if (!memSnapshot)
+        return "Could not take snapshot!";
+
+    const auto heapSnapshot = guestHeap.snapshot();
+
+    // Restoring must undo writes, frees and allocations, every time.
+    for (auto round = 0u; round < 2u; ++round) {
+        for (auto i = 1u; i < NUM_BLOCKS; i += 2u)
+            std::memset(hostPtr(*mem, blocks[i].vaddr), ~blocks[i].pattern, blocks[i].size);
+
+        for (auto i = 2u; i < NUM_BLOCKS; i += 4u) {
+            if (!mem->free(blocks[i].vaddr))
+                return "Free failed!";
+        }
+
+        const auto newVAddr = mem->allocate({ .size = 0x10000 }).value()->virtualBase;
+        std::memset(hostPtr(*mem, newVAddr), 0xFF, 0x10000);
+        for (auto i = 0u; i < NUM_BLOCKS; ++i)
+            guestHeap.allocate(randomSize<1, 8192>());
+
+        if (!mem->restore(*memSnapshot.value()) || !guestHeap.restore(*heapSnapshot))
+            return "Could not restore snapshot!";
+
+        if (!checkBlocks(*mem, blocks))
+            return "Blocks don't match the snapshot!";
+
+        if (mem->usedMemory() != usedMemory)
+            return "Used memory doesn't match the snapshot!";
+
+        if (mem->blockFromVAddr(newVAddr) && mem->blockFromVAddr(newVAddr)->virtualBase == newVAddr)
+            return "Allocation made after the snapshot is still there!";
+
+        // Fresh pages must not leak contents from the image.
+        const auto freshVAddr = mem->allocate({ .size = 0x10000 }).value()->virtualBase;
+        const auto fresh = hostPtr(*mem, freshVAddr + 0x1000);
+        for (auto i = 0u; zeroed && i < 0xE000; ++i) {
+            if (fresh[i])
+                return "Fresh allocation is not zeroed!";
+        }
+
+        for (const auto vaddr : heapObjects) {
+            const auto obj = guestHeap.allocate(16u).value();
+            if (obj == vaddr)
+                return "Heap handed out a live object!";
+
+            guestHeap.free(obj);
+        }
+    }
+
+    // Forking into another manager.
+    if (forkAllocator) {
+        memory::MemoryManager fork(std::move(forkAllocator), MEMORY_SIZE);
+        if (!fork.restore(*memSnapshot.value()))
+            return "Could not fork snapshot!";
+
+        std::memset(hostPtr(fork, blocks[1].vaddr), ~blocks[1].pattern, blocks[1].size);
+        if (!checkBlocks(*mem, blocks))
+            return "Fork writes are visible to the parent!";
+
+        blocks.erase(blocks.begin() + 1u);
+        if (!checkBlocks(fork, blocks))
+            return "Fork doesn't match the snapshot!";
+    }
+
+    return nullptr;
+}
+
+// Test snapshots restoration, with both copies and mapped images.
+DASHLE_TEST(Memory::Snapshot) {
+    if (const auto error = testAllocator(std::make_unique<memory::HostAllocator>(), std::make_unique<memory::HostAllocator>(), false)) {
+        TEST_FAILED(std::format("HostAllocator: {}", error));
+    }
+
+    if (const auto error = testAllocator(std::make_unique<memory::MappedAllocator>(), std::make_unique<memory::MappedAllocator>(), true)) {
+        TEST_FAILED(std::format("MappedAllocator: {}", error));
+    }
+
+    TEST_PASSED();
+}
@@ -0,0 +1,111 @@
+#include "DasHLE/Host/Sync.h"
+#include "Test.h"
+
+#include <thread>
+#include <vector>
+
+constexpr static usize NUM_THREADS = 8u;
+constexpr static usize NUM_ITERATIONS = 100000u;
+
+template <typename Fn>
+static void runThreads(Fn fn) {
+    std::vector<std::thread> threads;
+    for (auto i = 0u; i < NUM_THREADS; ++i)
+        threads.emplace_back(fn, i + 1u);
+
+    for (auto& thread : threads)
+        thread.join();
+}
+
+// Make sure mutexes, condition variables and semaphores work under contention.
+DASHLE_TEST(Sync::Sync) {
+    // Mutual exclusion, for every type.
+    for (const auto type : { host::sync::mutex::TYPE_NORMAL, host::sync::mutex::TYPE_RECURSIVE, host::sync::mutex::TYPE_ERRORCHECK }) {
+        u32 mutex = 0u;
+        usize counter = 0u;
+        host::sync::mutexInit(mutex, type);
+        runThreads([&](u32 owner) {
+            for (auto i = 0u; i < NUM_ITERATIONS; ++i) {
+                DASHLE_ASSERT(host::sync::mutexLock(mutex, owner));
+                ++counter;
+                DASHLE_ASSERT(host::sync::mutexUnlock(mutex, owner));
+            }
+        });
+
+        if (counter != NUM_THREADS * NUM_ITERATIONS || mutex != type) {
+            TEST_FAILED("Mutex lost updates!");
+        }
+    }
+
+    // Ownership rules.
+    u32 recursive = 0u;
+    host::sync::mutexInit(recursive, host::sync::mutex::TYPE_RECURSIVE);
+    if (!host::sync::mutexLock(recursive, 1u) || !host::sync::mutexLock(recursive, 1u) || host::sync::mutexUnlock(recursive, 2u)
+        || !host::sync::mutexUnlock(recursive, 1u) || !host::sync::mutexUnlock(recursive, 1u) || host::sync::mutexUnlock(recursive, 1u)) {
+        TEST_FAILED("Recursive mutex misbehaved!");
+    }
+
+    u32 errorCheck = 0u;
+    host::sync::mutexInit(errorCheck, host::sync::mutex::TYPE_ERRORCHECK);
+    const auto lock = host::sync::mutexLock(errorCheck, 1u);
+    const auto relock = host::sync::mutexLock(errorCheck, 1u);
+    if (!lock || relock || relock.error() != Error::Duplicate || host::sync::mutexUnlock(errorCheck, 2u) || !host::sync::mutexUnlock(errorCheck, 1u)) {
+        TEST_FAILED("Error checking mutex misbehaved!");
+    }
+
+    // Producers and consumers through a condition variable.
+    {
+        u32 mutex = 0u;
+        u32 cond = 0u;
+        usize available = 0u;
+        usize consumed = 0u;
+        host::sync::mutexInit(mutex, host::sync::mutex::TYPE_NORMAL);
+        host::sync::condInit(cond);
+        runThreads([&](u32 owner) {
+            for (auto i = 0u; i < NUM_ITERATIONS / 10u; ++i) {
+                DASHLE_ASSERT(host::sync::mutexLock(mutex, owner));
+                if (owner & 1u) {
+                    ++available;
+                    host::sync::condSignal(cond);
+                } else {
+                    while (!available)
+                        DASHLE_ASSERT(host::sync::condWait(cond, mutex, owner));
+
+                    --available;
+                    ++consumed;
+                }
+                DASHLE_ASSERT(host::sync::mutexUnlock(mutex, owner));
+            }
+        });
+
+        if (consumed != NUM_THREADS / 2u * (NUM_ITERATIONS / 10u) || available) {
+            TEST_FAILED("Condition variable lost signals!");
+        }
+    }
+
+    // Producers and consumers through a semaphore.
+    {
+        u32 sem = 0u;
+        host::sync::semInit(sem, 0u);
+        runThreads([&](u32 owner) {
+            for (auto i = 0u; i < NUM_ITERATIONS; ++i) {
+                if (owner & 1u) {
+                    DASHLE_ASSERT(host::sync::semPost(sem));
+                } else {
+                    host::sync::semWait(sem);
+                }
+            }
+        });
+
+        if (static_cast<s32>(sem) > 0) {
+            TEST_FAILED("Semaphore lost waits!");
+        }
+
+        host::sync::semInit(sem, 0x7FFFFFFF);
+        if (host::sync::semPost(sem)) {
+            TEST_FAILED("Semaphore overflowed!");
+        }
+    }
+
+    TEST_PASSED();
+}